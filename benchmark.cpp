@@ -0,0 +1,1295 @@
+// Standalone benchmarks for the terrain generator, no OpenGL context required
+// Build: c++ -std=gnu++17 -O2 -Ilib benchmark.cpp -o benchmark -pthread
+// Usage: ./benchmark [section], runs every section when none is given
+// Run from the repository root, 'benchmark cache' loads the plant models from obj/
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+#include "perlin.h"
+#include "perlin_simd.h"
+#include "fbm.h"
+#include "chunk_arena.h"
+#include "chunk_edges.h"
+#include "chunk_seams.h"
+#include "clipmap.h"
+#include "fbm_multirate.h"
+#include "heap_counter.h"
+#include "heightfield.h"
+#include "noise_backend.h"
+#include "thread_pool.h"
+#include "terrain.h"
+#include "terrain_lod.h"
+#include "vertex_cache.h"
+
+// Average nanoseconds per call of fn over the given number of repeats
+template <typename F>
+double time_ns(F fn, int repeats) {
+    fn();   // Warm up caches and dispatch
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; i++)
+        fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / repeats;
+}
+
+// Keeps results alive so the optimizer can't drop the work being timed
+volatile double benchmarkSink;
+
+// Sample coordinates spread like generate_noise_map's octaves over a chunk
+void fill_samples(std::vector<float> &xs, std::vector<float> &ys, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> coord(0, 64);
+    for (int i = 0; i < xs.size(); i++) {
+        xs[i] = coord(rng);
+        ys[i] = coord(rng);
+    }
+}
+
+void bench_simd() {
+    const int n = 127 * 127;
+    std::vector<float> xs(n), ys(n);
+    std::vector<double> expected(n), actual(n);
+    std::vector<int> p = get_permutation_vector();
+    fill_samples(xs, ys, 1);
+
+    struct kernel { const char *name; perlin_batch_fn fn; bool supported; };
+    std::vector<kernel> kernels = { { "scalar", perlin_noise_2d_batch_scalar, true } };
+#ifdef PERLIN_SIMD_X86
+    __builtin_cpu_init();
+    kernels.push_back({ "sse4.1", perlin_noise_2d_batch_sse41, (bool)__builtin_cpu_supports("sse4.1") });
+    kernels.push_back({ "avx2",   perlin_noise_2d_batch_avx2,  (bool)__builtin_cpu_supports("avx2") });
+#endif
+
+    perlin_noise_2d_batch_scalar(xs.data(), ys.data(), expected.data(), n, p.data());
+
+    printf("== simd: perlin_noise_2d batch kernels, %d samples ==\n", n);
+    double scalarNs = 0;
+    for (const kernel &k : kernels) {
+        if (!k.supported) {
+            printf("%-8s unsupported on this CPU\n", k.name);
+            continue;
+        }
+        double ns = time_ns([&] {
+            k.fn(xs.data(), ys.data(), actual.data(), n, p.data());
+            benchmarkSink = actual[n - 1];
+        }, 50) / n;
+        if (scalarNs == 0)
+            scalarNs = ns;
+
+        double maxError = 0;
+        for (int i = 0; i < n; i++)
+            maxError = std::fmax(maxError, std::fabs(actual[i] - expected[i]));
+        printf("%-8s %6.2f ns/sample  %5.2fx  max |error| %.3g\n", k.name, ns, scalarNs / ns, maxError);
+    }
+
+    // Single precision kernels, error measured against the double precision scalar path
+    struct kernelF { const char *name; perlin_batch_f_fn fn; bool supported; };
+    std::vector<kernelF> kernelsF = { { "scalar", perlin_noise_2d_batch_f_scalar, true } };
+#ifdef PERLIN_SIMD_X86
+    kernelsF.push_back({ "sse4.1", perlin_noise_2d_batch_f_sse41, (bool)__builtin_cpu_supports("sse4.1") });
+    kernelsF.push_back({ "avx2",   perlin_noise_2d_batch_f_avx2,  (bool)__builtin_cpu_supports("avx2") });
+#endif
+    std::vector<float> actualF(n);
+
+    printf("-- single precision --\n");
+    for (const kernelF &k : kernelsF) {
+        if (!k.supported) {
+            printf("%-8s unsupported on this CPU\n", k.name);
+            continue;
+        }
+        double ns = time_ns([&] {
+            k.fn(xs.data(), ys.data(), actualF.data(), n, p.data());
+            benchmarkSink = actualF[n - 1];
+        }, 50) / n;
+
+        double maxError = 0;
+        for (int i = 0; i < n; i++)
+            maxError = std::fmax(maxError, std::fabs(actualF[i] - expected[i]));
+        printf("%-8s %6.2f ns/sample  %5.2fx  max |error| %.3g\n", k.name, ns, scalarNs / ns, maxError);
+    }
+}
+
+void bench_2d() {
+    const int n = 127 * 127;
+    std::vector<float> xs(n), ys(n);
+    std::vector<int> p = get_permutation_vector();
+    fill_samples(xs, ys, 2);
+
+    double ns3d = time_ns([&] {
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+            sum += perlin_noise(xs[i], ys[i], 0, p.data());
+        benchmarkSink = sum;
+    }, 50) / n;
+    double ns2d = time_ns([&] {
+        double sum = 0;
+        for (int i = 0; i < n; i++)
+            sum += perlin_noise_2d(xs[i], ys[i], p.data());
+        benchmarkSink = sum;
+    }, 50) / n;
+
+    printf("== 2d: scalar noise per sample ==\n");
+    printf("perlin_noise (3D, z = 0) %6.2f ns/sample\n", ns3d);
+    printf("perlin_noise_2d          %6.2f ns/sample  %.0f%% saved\n", ns2d, 100 * (1 - ns2d / ns3d));
+}
+
+// Default map settings from main.cpp
+const FbmParams DEFAULT_FBM = { 5, 64, 0.5f, 2, SINGLE_PRECISION, PERLIN_BACKEND, LATTICE_CELLS };
+
+// generate_fbm() against the per-sample octave loop it replaced, which recomputed every octave's amplitude
+// and frequency for each sample and called the scalar noise one sample at a time
+void bench_fbm() {
+    const int width = 127, height = 127;
+    std::vector<float> heights(width * height), reference(width * height);
+    FbmOctaves fbm = get_fbm_octaves(DEFAULT_FBM);
+    NoiseContext noise;
+
+    double perSampleNs = time_ns([&] {
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++) {
+                float amp = 1, freq = 1, noiseHeight = 0, maxPossibleHeight = 0;
+                for (int i = 0; i < DEFAULT_FBM.octaves; i++) {
+                    noiseHeight += perlin_noise_2d(x / DEFAULT_FBM.noiseScale * freq, y / DEFAULT_FBM.noiseScale * freq, noise.perm()) * amp;
+                    maxPossibleHeight += amp;
+                    amp  *= DEFAULT_FBM.persistence;
+                    freq *= DEFAULT_FBM.lacunarity;
+                }
+                reference[x + y*width] = (noiseHeight + 1) / maxPossibleHeight;
+            }
+        benchmarkSink = reference[0];
+    }, 20);
+    double fbmNs = time_ns([&] {
+        generate_fbm(heights.data(), width, height, 0, 0, fbm, noise);
+        benchmarkSink = heights[0];
+    }, 20);
+
+    double maxError = 0;
+    for (int i = 0; i < width * height; i++)
+        maxError = std::fmax(maxError, std::fabs(heights[i] - reference[i]));
+
+    printf("== fbm: one %dx%d chunk, %d octaves ==\n", width, height, fbm.count);
+    printf("per-sample loop %7.3f ms/chunk\n", perSampleNs / 1e6);
+    printf("generate_fbm    %7.3f ms/chunk  %5.2fx  max |error| %.3g\n", fbmNs / 1e6, perSampleNs / fbmNs, maxError);
+
+    // The compile-time octave loop against the runtime one, in every backend and precision
+    std::vector<float> fixed(width * height);
+    printf("backend  precision  runtime ms  generate_fbm<5, 127, 127> ms  identical\n");
+    for (NoiseBackend backend : { PERLIN_BACKEND, SIMPLEX_BACKEND })
+        for (NoisePrecision precision : { SINGLE_PRECISION, DOUBLE_PRECISION }) {
+            FbmParams params = DEFAULT_FBM;
+            params.backend = backend;
+            params.precision = precision;
+            FbmOctaves modeFbm = get_fbm_octaves(params);
+            double runtimeNs = time_ns([&] {
+                generate_fbm(heights.data(), width, height, 0, 0, modeFbm, noise);
+                benchmarkSink = heights[0];
+            }, 20);
+            double fixedNs = time_ns([&] {
+                generate_fbm<5, 127, 127>(fixed.data(), 0, 0, modeFbm, noise);
+                benchmarkSink = fixed[0];
+            }, 20);
+            printf("%-7s  %-9s  %10.3f  %28.3f  %s\n", modeFbm.kernels->name, precision == SINGLE_PRECISION ? "float" : "double",
+                   runtimeNs / 1e6, fixedNs / 1e6, fixed == heights ? "yes" : "NO");
+        }
+}
+
+// Several worlds generated concurrently from shared, read-only noise contexts
+void bench_worlds() {
+    const int width = 127, height = 127, nWorlds = 4, nChunks = 8;
+    FbmOctaves fbm = get_fbm_octaves(DEFAULT_FBM);
+    const NoiseContext worlds[nWorlds] = { NoiseContext(1), NoiseContext(2), NoiseContext(3), NoiseContext(4) };
+
+    auto generate_world = [&](int w, std::vector<float> &heights) {
+        for (int c = 0; c < nChunks; c++)
+            generate_fbm(&heights[c * width * height], width, height, c * (width-1), 0, fbm, worlds[w]);
+    };
+
+    std::vector<std::vector<float>> serial(nWorlds, std::vector<float>(nChunks * width * height));
+    std::vector<std::vector<float>> concurrent = serial;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int w = 0; w < nWorlds; w++)
+        generate_world(w, serial[w]);
+    auto mid = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int w = 0; w < nWorlds; w++)
+        threads.push_back(std::thread(generate_world, w, std::ref(concurrent[w])));
+    for (std::thread &t : threads)
+        t.join();
+    auto end = std::chrono::steady_clock::now();
+
+    bool identical = serial == concurrent;
+    bool distinct = serial[0] != serial[1];
+    printf("== worlds: %d seeds x %d chunks ==\n", nWorlds, nChunks);
+    printf("serial     %7.2f ms\n", std::chrono::duration<double, std::milli>(mid - start).count());
+    printf("concurrent %7.2f ms on %u hardware threads\n", std::chrono::duration<double, std::milli>(end - mid).count(), std::thread::hardware_concurrency());
+    printf("concurrent output %s serial, seeds %s\n", identical ? "matches" : "DIFFERS FROM", distinct ? "give distinct worlds" : "COLLIDE");
+}
+
+// Speedup of one chunk split across a thread pool, against the serial generator
+void bench_parallel() {
+    const int widths[] = { 63, 127, 255, 511 };
+    const int threadCounts[] = { 1, 2, 4, 8 };
+    FbmOctaves fbm = get_fbm_octaves(DEFAULT_FBM);
+    NoiseContext noise;
+
+    printf("== parallel: one chunk, rows split across threads (%u hardware threads) ==\n", std::thread::hardware_concurrency());
+    printf("chunkWidth  serial ms");
+    for (int threads : threadCounts)
+        printf("  %dT speedup", threads);
+    printf("\n");
+
+    for (int width : widths) {
+        std::vector<float> serial(width * width), parallel(width * width);
+        double serialNs = time_ns([&] {
+            generate_fbm(serial.data(), width, width, 0, 0, fbm, noise);
+        }, 5);
+        printf("%10d  %9.3f", width, serialNs / 1e6);
+
+        bool identical = true;
+        for (int threads : threadCounts) {
+            ThreadPool pool(threads);
+            double parallelNs = time_ns([&] {
+                generate_fbm_parallel(pool, parallel.data(), width, width, 0, 0, fbm, noise);
+            }, 5);
+            identical = identical && parallel == serial;
+            printf("  %10.2fx", serialNs / parallelNs);
+        }
+        printf("  %s\n", identical ? "identical" : "OUTPUT DIFFERS");
+    }
+}
+
+// Compares single and double precision height maps in world units across many chunks and seeds
+void bench_precision() {
+    const int width = 127, height = 127, gridSize = 8, nSeeds = 8;
+    const float meshHeight = 32, waterHeight = 0.1;
+    FbmParams params = DEFAULT_FBM;
+    params.precision = DOUBLE_PRECISION;
+    FbmOctaves fbmDouble = get_fbm_octaves(params);
+    params.precision = SINGLE_PRECISION;
+    FbmOctaves fbmSingle = get_fbm_octaves(params);
+
+    std::vector<float> reference(width * height), fast(width * height);
+    double maxError = 0, sumSquares = 0, doubleNs = 0, singleNs = 0;
+    long samples = 0;
+
+    for (int seed = 0; seed < nSeeds; seed++) {
+        NoiseContext noise(seed);
+        for (int cy = 0; cy < gridSize; cy++)
+            for (int cx = 0; cx < gridSize; cx++) {
+                int originX = cx * (width-1), originY = cy * (height-1);
+                doubleNs += time_ns([&] {
+                    generate_fbm(reference.data(), width, height, originX, originY, fbmDouble, noise);
+                }, 1);
+                singleNs += time_ns([&] {
+                    generate_fbm(fast.data(), width, height, originX, originY, fbmSingle, noise);
+                }, 1);
+
+                for (int i = 0; i < width * height; i++) {
+                    double error = ease_height(fast[i], meshHeight, waterHeight) - ease_height(reference[i], meshHeight, waterHeight);
+                    maxError = std::fmax(maxError, std::fabs(error));
+                    sumSquares += error * error;
+                    samples++;
+                }
+            }
+    }
+
+    int nChunks = gridSize * gridSize * nSeeds;
+    printf("== precision: %d chunks over %d seeds, meshHeight %.0f ==\n", nChunks, nSeeds, meshHeight);
+    printf("double %7.3f ms/chunk\n", doubleNs / nChunks / 1e6);
+    printf("single %7.3f ms/chunk  %.2fx\n", singleNs / nChunks / 1e6, doubleNs / singleNs);
+    printf("height error: max %.3g, RMS %.3g world units\n", maxError, std::sqrt(sumSquares / samples));
+}
+
+// Throughput of each noise backend, per sample and per chunk
+void bench_backends() {
+    const int n = 127 * 127, width = 127, height = 127;
+    const NoiseBackend backends[] = { PERLIN_BACKEND, SIMPLEX_BACKEND };
+    std::vector<float> xs(n), ys(n), valuesF(n), heights(width * height);
+    std::vector<double> values(n);
+    NoiseContext noise;
+    fill_samples(xs, ys, 3);
+
+    printf("== backends: samples per second and chunk cost ==\n");
+    printf("backend   precision  Msamples/s  ms/chunk  range\n");
+    for (NoiseBackend backend : backends) {
+        const NoiseKernels &kernels = get_noise_kernels(backend);
+        for (int precision = DOUBLE_PRECISION; precision <= SINGLE_PRECISION; precision++) {
+            double ns;
+            float minValue = 0, maxValue = 0;
+            if (precision == SINGLE_PRECISION) {
+                ns = time_ns([&] { kernels.batchF(xs.data(), ys.data(), valuesF.data(), n, noise.perm()); }, 50);
+                for (float v : valuesF) {
+                    minValue = std::fmin(minValue, v);
+                    maxValue = std::fmax(maxValue, v);
+                }
+            } else {
+                ns = time_ns([&] { kernels.batch(xs.data(), ys.data(), values.data(), n, noise.perm()); }, 50);
+                for (double v : values) {
+                    minValue = std::fmin(minValue, v);
+                    maxValue = std::fmax(maxValue, v);
+                }
+            }
+
+            FbmParams params = DEFAULT_FBM;
+            params.precision = (NoisePrecision)precision;
+            params.backend = backend;
+            FbmOctaves fbm = get_fbm_octaves(params);
+            double chunkNs = time_ns([&] {
+                generate_fbm(heights.data(), width, height, 0, 0, fbm, noise);
+                benchmarkSink = heights[0];
+            }, 10);
+
+            printf("%-9s %-9s  %10.1f  %8.3f  %.2f to %.2f\n", kernels.name, precision == SINGLE_PRECISION ? "single" : "double",
+                   n / ns * 1e3, chunkNs / 1e6, minValue, maxValue);
+        }
+    }
+}
+
+// Lattice cell walking against the batch kernels, per octave step and for whole chunks
+void bench_cells() {
+    const int width = 127, height = 127;
+    std::vector<float> xs(width), ys(width), valuesF(width), cellsF(width);
+    std::vector<float> heights(width * height), cellHeights(width * height);
+    NoiseContext noise;
+
+    printf("== cells: lattice cell walk vs batch kernel (single precision) ==\n");
+    printf("samples/cell  batch us/chunk  cells us/chunk  speedup  max diff\n");
+    for (int samplesPerCell = 64; samplesPerCell >= 1; samplesPerCell /= 2) {
+        float step = 1.0f / samplesPerCell;
+        for (int x = 0; x < width; x++)
+            xs[x] = x * step;
+
+        double maxDiff = 0;
+        double batchNs = time_ns([&] {
+            for (int y = 0; y < height; y++) {
+                std::fill(ys.begin(), ys.end(), y * step);
+                perlin_noise_2d_batch_f(xs.data(), ys.data(), valuesF.data(), width, noise.perm());
+            }
+            benchmarkSink = valuesF[0];
+        }, 20);
+        double cellsNs = time_ns([&] {
+            for (int y = 0; y < height; y++)
+                perlin_noise_2d_row_f(xs.data(), y * step, cellsF.data(), width, noise.perm());
+            benchmarkSink = cellsF[0];
+        }, 20);
+
+        for (int y = 0; y < height; y++) {
+            std::fill(ys.begin(), ys.end(), y * step);
+            perlin_noise_2d_batch_f(xs.data(), ys.data(), valuesF.data(), width, noise.perm());
+            perlin_noise_2d_row_f(xs.data(), y * step, cellsF.data(), width, noise.perm());
+            for (int x = 0; x < width; x++)
+                maxDiff = std::fmax(maxDiff, std::fabs(valuesF[x] - cellsF[x]));
+        }
+
+        printf("%12d  %14.1f  %14.1f  %6.2fx  %.3g\n", samplesPerCell, batchNs / 1e3, cellsNs / 1e3, batchNs / cellsNs, maxDiff);
+    }
+
+    printf("precision  per sample ms/chunk  cells ms/chunk  speedup  max diff\n");
+    for (int precision = DOUBLE_PRECISION; precision <= SINGLE_PRECISION; precision++) {
+        FbmParams params = DEFAULT_FBM;
+        params.precision = (NoisePrecision)precision;
+        params.evaluation = PER_SAMPLE;
+        FbmOctaves perSample = get_fbm_octaves(params);
+        params.evaluation = LATTICE_CELLS;
+        FbmOctaves cells = get_fbm_octaves(params);
+
+        double perSampleNs = time_ns([&] {
+            generate_fbm(heights.data(), width, height, 0, 0, perSample, noise);
+            benchmarkSink = heights[0];
+        }, 20);
+        double cellsNs = time_ns([&] {
+            generate_fbm(cellHeights.data(), width, height, 0, 0, cells, noise);
+            benchmarkSink = cellHeights[0];
+        }, 20);
+
+        double maxDiff = 0;
+        for (int i = 0; i < width * height; i++)
+            maxDiff = std::fmax(maxDiff, std::fabs(heights[i] - cellHeights[i]));
+
+        printf("%-9s  %19.3f  %14.3f  %6.2fx  %.3g\n", precision == SINGLE_PRECISION ? "single" : "double",
+               perSampleNs / 1e6, cellsNs / 1e6, perSampleNs / cellsNs, maxDiff);
+    }
+}
+
+// Cost and world height error of generating chunks with fewer octaves
+void bench_detail() {
+    const int width = 127, height = 127, gridSize = 4;
+    const float meshHeight = 32, waterHeight = 0.1;
+    FbmParams params = DEFAULT_FBM;
+    FbmOctaves full = get_fbm_octaves(params);
+    std::vector<float> reference(width * height), truncated(width * height);
+    NoiseContext noise;
+
+    printf("== detail: octave budget against the full %d octaves ==\n", full.count);
+    printf("octaves  ms/chunk  max error  octave bound (world units)\n");
+    for (int budget = full.count; budget >= 1; budget--) {
+        FbmOctaves fbm = truncate_fbm_octaves(full, FbmDetail{ budget, 0 });
+        double ns = 0, maxError = 0;
+
+        for (int cy = 0; cy < gridSize; cy++)
+            for (int cx = 0; cx < gridSize; cx++) {
+                int originX = cx * (width-1), originY = cy * (height-1);
+                generate_fbm(reference.data(), width, height, originX, originY, full, noise);
+                ns += time_ns([&] {
+                    generate_fbm(truncated.data(), width, height, originX, originY, fbm, noise);
+                }, 1);
+
+                for (int i = 0; i < width * height; i++) {
+                    double error = ease_height(truncated[i], meshHeight, waterHeight) - ease_height(reference[i], meshHeight, waterHeight);
+                    maxError = std::fmax(maxError, std::fabs(error));
+                }
+            }
+
+        // What truncate_fbm_octaves() assumes the dropped octaves can cost, at a normalized height of 1
+        float dropped = 0;
+        for (int i = fbm.count; i < full.count; i++)
+            dropped += full.amp[i] / full.maxPossibleHeight;
+
+        printf("%7d  %8.3f  %9.3f  %.3f\n", budget, ns / (gridSize * gridSize) / 1e6, maxError, dropped * ease_height_slope(1, meshHeight));
+    }
+
+    // Octaves a budget drops count against the quantum, so adding one never drops more than the quantum alone
+    printf("world quantum  octaves kept  with a budget of 3\n");
+    for (float worldQuantum = 0.5; worldQuantum <= 32; worldQuantum *= 1.5) {
+        float heightQuantum = worldQuantum / ease_height_slope(1, meshHeight);
+        FbmOctaves fbm = truncate_fbm_octaves(full, FbmDetail{ 0, heightQuantum }),
+                   budgeted = truncate_fbm_octaves(full, FbmDetail{ 3, heightQuantum });
+        printf("%13.1f  %12d  %18d\n", worldQuantum, fbm.count, budgeted.count);
+    }
+}
+
+// Whole world generation with and without copying chunk edges from neighbours
+void bench_edges() {
+    const int width = 127, height = 127, chunksX = 10, chunksY = 10;
+    FbmParams params = DEFAULT_FBM;
+    FbmOctaves fbm = get_fbm_octaves(params);
+    NoiseContext noise;
+    ThreadPool pool(1);
+    std::vector<float> world(chunksX * chunksY * width * height), cachedWorld(world.size());
+
+    double ns = time_ns([&] {
+        for (int cy = 0; cy < chunksY; cy++)
+            for (int cx = 0; cx < chunksX; cx++)
+                generate_fbm_parallel(pool, &world[(cx + cy * chunksX) * width * height], width, height,
+                                                   cx * (width-1), cy * (height-1), fbm, noise);
+    }, 1);
+
+    ChunkEdgeCache edgeCache(chunksX, chunksY, width, height);
+    double cachedNs = time_ns([&] {
+        for (int cy = 0; cy < chunksY; cy++)
+            for (int cx = 0; cx < chunksX; cx++)
+                generate_fbm_chunk(pool, edgeCache, cx, cy, &cachedWorld[(cx + cy * chunksX) * width * height], width, height,
+                                                cx * (width-1), cy * (height-1), fbm, noise);
+    }, 1);
+
+    long total = (long)world.size(), mismatches = 0;
+    for (long i = 0; i < total; i++)
+        mismatches += world[i] != cachedWorld[i];
+
+    printf("== edges: %dx%d chunks of %dx%d, one thread ==\n", chunksX, chunksY, width, height);
+    printf("no cache    %7.2f ms  %ld samples evaluated\n", ns / 1e6, total);
+    printf("edge cache  %7.2f ms  %ld samples evaluated, %ld copied (%.1f%%)\n", cachedNs / 1e6,
+           total - edgeCache.saved_samples(), edgeCache.saved_samples(), 100.0 * edgeCache.saved_samples() / total);
+    printf("samples differing from the uncached world: %ld\n", mismatches);
+}
+
+// Chunks keeping fewer octaves the further they are from the middle of the grid, generated with one sample of apron
+// on their own octaves, with seam octaves, and with seam octaves copying the samples earlier chunks share,
+// samples shared with the neighbour to the right or above are compared
+void bench_seams() {
+    const int width = 127, height = 127, chunksX = 6, chunksY = 6, apronWidth = width + 2, apronHeight = height + 2;
+    FbmOctaves full = get_fbm_octaves(DEFAULT_FBM);
+    NoiseContext noise;
+    auto chunk_octaves = [&](int cx, int cy) {
+        int distance = std::max(std::abs(cx - chunksX / 2), std::abs(cy - chunksY / 2));
+        return truncate_fbm_octaves(full, FbmDetail{ std::max(full.count - distance, 1), 0 });
+    };
+
+    std::vector<std::vector<float>> own(chunksX * chunksY, std::vector<float>(apronWidth * apronHeight)), seamed = own, cached = own;
+    std::vector<std::vector<float>> heights(chunksX * chunksY, std::vector<float>(width * height)), dx = heights, dy = heights;
+    std::vector<std::vector<float>> cachedHeights = heights, cachedDx = heights, cachedDy = heights;
+    ChunkEdgeCache apronCache(chunksX, chunksY, width, height, 1, 1), derivativeCache(chunksX, chunksY, width, height, 0, 3);
+    double ownNs = 0, seamNs = 0, cachedNs = 0, derivativeNs = 0, cachedDerivativeNs = 0;
+    for (int cy = 0; cy < chunksY; cy++)
+        for (int cx = 0; cx < chunksX; cx++) {
+            int c = cx + cy * chunksX, originX = cx * (width-1), originY = cy * (height-1);
+            FbmOctaves fbm = chunk_octaves(cx, cy);
+            ChunkSeamOctaves seams = get_seam_octaves(cx, cy, chunk_octaves);
+            ownNs += time_ns([&] {
+                generate_fbm(own[c].data(), apronWidth, apronHeight, originX - 1, originY - 1, fbm, noise);
+            }, 1);
+            seamNs += time_ns([&] {
+                for_each_seam_block(seams, width, height, -1, width + 1, -1, height + 1, [&](const FbmOctaves &blockFbm, int firstX, int lastX, int firstY, int lastY) {
+                    generate_fbm_block(seamed[c].data(), apronWidth, firstX + 1, lastX + 1, firstY + 1, lastY + 1, originX - 1, originY - 1, blockFbm, noise);
+                });
+            }, 1);
+            cachedNs += time_ns([&] {
+                float *blocks[1] = { cached[c].data() };
+                apronCache.fetch_block(cx, cy, blocks, apronWidth);
+                ChunkRect rect = apronCache.uncached(cx, cy);
+                for_each_seam_block(seams, width, height, rect.firstX, rect.lastX, rect.firstY, rect.lastY, [&](const FbmOctaves &blockFbm, int firstX, int lastX, int firstY, int lastY) {
+                    generate_fbm_block(cached[c].data(), apronWidth, firstX + 1, lastX + 1, firstY + 1, lastY + 1, originX - 1, originY - 1, blockFbm, noise);
+                });
+                apronCache.store_block(cx, cy, blocks, apronWidth);
+                apronCache.finish(cx, cy);
+            }, 1);
+            derivativeNs += time_ns([&] {
+                for_each_seam_block(seams, width, height, 0, width, 0, height, [&](const FbmOctaves &blockFbm, int firstX, int lastX, int firstY, int lastY) {
+                    generate_fbm_derivative_block(heights[c].data(), dx[c].data(), dy[c].data(), width, firstX, lastX, firstY, lastY, originX, originY, blockFbm, noise);
+                });
+            }, 1);
+            cachedDerivativeNs += time_ns([&] {
+                float *blocks[3] = { cachedHeights[c].data(), cachedDx[c].data(), cachedDy[c].data() };
+                derivativeCache.fetch_block(cx, cy, blocks, width);
+                ChunkRect rect = derivativeCache.uncached(cx, cy);
+                for_each_seam_block(seams, width, height, rect.firstX, rect.lastX, rect.firstY, rect.lastY, [&](const FbmOctaves &blockFbm, int firstX, int lastX, int firstY, int lastY) {
+                    generate_fbm_derivative_block(cachedHeights[c].data(), cachedDx[c].data(), cachedDy[c].data(), width, firstX, lastX, firstY, lastY, originX, originY, blockFbm, noise);
+                });
+                derivativeCache.store_block(cx, cy, blocks, width);
+                derivativeCache.finish(cx, cy);
+            }, 1);
+        }
+
+    // Apron columns width - 2 to width of a chunk are columns -1 to 1 of the chunk to its right, likewise for rows
+    auto mismatches = [&](const std::vector<std::vector<float>> &world) {
+        long count = 0;
+        for (int cy = 0; cy < chunksY; cy++)
+            for (int cx = 0; cx < chunksX; cx++) {
+                const std::vector<float> &chunk = world[cx + cy * chunksX];
+                for (int i = 0; i < apronHeight && cx + 1 < chunksX; i++)
+                    for (int j = 0; j < 3; j++)
+                        count += chunk[width - 1 + j + i * apronWidth] != world[cx + 1 + cy * chunksX][j + i * apronWidth];
+                for (int i = 0; i < apronWidth && cy + 1 < chunksY; i++)
+                    for (int j = 0; j < 3; j++)
+                        count += chunk[i + (height - 1 + j) * apronWidth] != world[cx + (cy + 1) * chunksX][i + j * apronWidth];
+            }
+        return count;
+    };
+    long derivativeMismatches = 0, cacheMismatches = 0;
+    for (int cy = 0; cy < chunksY; cy++)
+        for (int cx = 0; cx + 1 < chunksX; cx++)
+            for (int y = 0; y < height; y++) {
+                int c = cx + cy * chunksX, left = width - 1 + y * width, right = y * width;
+                derivativeMismatches += heights[c][left] != heights[c + 1][right] || dx[c][left] != dx[c + 1][right] || dy[c][left] != dy[c + 1][right];
+            }
+    for (int c = 0; c < chunksX * chunksY; c++)
+        cacheMismatches += cached[c] != seamed[c] || cachedHeights[c] != heights[c] || cachedDx[c] != dx[c] || cachedDy[c] != dy[c];
+
+    int chunks = chunksX * chunksY;
+    printf("== seams: %dx%d chunks of %dx%d with apron, %d octaves in the middle down to %d at the corners ==\n",
+           chunksX, chunksY, width, height, full.count, chunk_octaves(0, 0).count);
+    printf("own octaves   %6.3f ms/chunk  shared samples differing: %ld\n", ownNs / chunks / 1e6, mismatches(own));
+    printf("seam octaves  %6.3f ms/chunk  shared samples differing: %ld\n", seamNs / chunks / 1e6, mismatches(seamed));
+    printf("edge cache    %6.3f ms/chunk  shared samples differing: %ld, %ld samples copied\n", cachedNs / chunks / 1e6,
+           mismatches(cached), apronCache.saved_samples());
+    printf("derivatives   %6.3f ms/chunk, with edge cache %6.3f ms/chunk, %ld samples copied\n", derivativeNs / chunks / 1e6,
+           cachedDerivativeNs / chunks / 1e6, derivativeCache.saved_samples());
+    printf("derivative seams: border vertices differing %ld, chunks differing with the edge caches %ld\n", derivativeMismatches, cacheMismatches);
+}
+
+// Catmull-Rom upsampling error of raw noise, then the cost and error of multi-rate chunks
+void bench_multirate() {
+    const int width = 127, height = 127, gridSize = 4;
+    const float meshHeight = 32;
+    NoiseContext noise;
+    ThreadPool pool(1);
+
+    printf("== multirate: Catmull-Rom error of unit noise sampled every h lattice units ==\n");
+    printf("h       max error  max / h^3\n");
+    for (float h = 1.0f / 32; h <= 0.5f; h *= 2) {
+        double maxError = 0;
+        for (int cy = 0; cy < 64; cy++)
+            for (int cx = 0; cx < 64; cx++) {
+                float taps[4][4], rows[4];
+                for (int j = 0; j < 4; j++)
+                    for (int i = 0; i < 4; i++)
+                        taps[j][i] = perlin_noise_2d((cx + i - 1) * h, (cy + j - 1) * h, noise.perm());
+
+                for (int sy = 0; sy < 4; sy++)
+                    for (int sx = 0; sx < 4; sx++) {
+                        CatmullRomWeights wx = catmull_rom_weights(0, sx / 4.0f), wy = catmull_rom_weights(0, sy / 4.0f);
+                        for (int j = 0; j < 4; j++)
+                            rows[j] = wx.w[0]*taps[j][0] + wx.w[1]*taps[j][1] + wx.w[2]*taps[j][2] + wx.w[3]*taps[j][3];
+                        float value = wy.w[0]*rows[0] + wy.w[1]*rows[1] + wy.w[2]*rows[2] + wy.w[3]*rows[3];
+                        double exact = perlin_noise_2d((cx + sx / 4.0f) * h, (cy + sy / 4.0f) * h, noise.perm());
+                        maxError = std::fmax(maxError, std::fabs(value - exact));
+                    }
+            }
+        printf("%-6.4f  %9.2e  %9.2f\n", h, maxError, maxError / (h * h * h));
+    }
+
+    FbmParams params = DEFAULT_FBM;
+    FbmOctaves fbm = get_fbm_octaves(params);
+    std::vector<float> reference(width * height), multiRate(width * height), neighbour(width * height);
+
+    printf("stride  error bound  coarse octaves  ms/chunk  max error  world units  seam mismatches\n");
+    const int strides[] = { 2, 4, 8 };
+    const float bounds[] = { 0, 1e-3, 4e-3, 1.6e-2 };
+    for (int stride : strides)
+        for (float bound : bounds) {
+            FbmMultiRate plan = plan_fbm_multirate(fbm, stride, bound);
+            double ns = 0, maxError = 0;
+            long seamMismatches = 0;
+
+            for (int cy = 0; cy < gridSize; cy++)
+                for (int cx = 0; cx < gridSize; cx++) {
+                    int originX = cx * (width-1), originY = cy * (height-1);
+                    generate_fbm(reference.data(), width, height, originX, originY, fbm, noise);
+                    ns += time_ns([&] {
+                        generate_fbm_multirate(pool, multiRate.data(), width, height, originX, originY, fbm, plan, noise);
+                    }, 1);
+                    for (int i = 0; i < width * height; i++)
+                        maxError = std::fmax(maxError, std::fabs(multiRate[i] - reference[i]));
+
+                    // Right edge against the left edge of the next chunk over
+                    generate_fbm_multirate(pool, neighbour.data(), width, height, originX + width-1, originY, fbm, plan, noise);
+                    for (int y = 0; y < height; y++)
+                        seamMismatches += multiRate[y*width + width-1] != neighbour[y*width];
+                }
+
+            printf("%6d  %11.1e  %14d  %8.3f  %9.2e  %11.3f  %15ld\n", stride, bound, plan.coarseOctaves,
+                   ns / (gridSize * gridSize) / 1e6, maxError, maxError * ease_height_slope(1, meshHeight), seamMismatches);
+        }
+}
+
+// Per triangle normals the way main.cpp made them before it had per vertex normals, without glm
+void face_cross_normals(const std::vector<float> &heights, int width, int height, std::vector<float> &normals) {
+    normals.clear();
+    for (int y = 0; y < height - 1; y++)
+        for (int x = 0; x < width - 1; x++) {
+            float h = heights[x + y*width], right = heights[x + 1 + y*width],
+                  up = heights[x + (y+1)*width], upRight = heights[x + 1 + (y+1)*width];
+            float triangles[2][3] = { { right - up, -1, h - up }, { h - upRight, -1, right - upRight } };
+            for (float *n : triangles) {
+                float length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                normals.push_back(-n[0] / length);
+                normals.push_back(-n[1] / length);
+                normals.push_back(-n[2] / length);
+            }
+        }
+}
+
+// Heights plus normals, face cross products against the noise derivatives
+void bench_normals() {
+    const int width = 127, height = 127;
+    const float meshHeight = 32, waterHeight = 0.1;
+    FbmParams params = DEFAULT_FBM;
+    FbmOctaves fbm = get_fbm_octaves(params);
+    NoiseContext noise;
+    ThreadPool pool(1);
+    std::vector<float> noiseMap(width * height), dx(width * height), dy(width * height), worldHeights(width * height), normals;
+    std::vector<float> neighbourMap(width * height), neighbourDx(width * height), neighbourDy(width * height);
+
+    double faceNs = time_ns([&] {
+        generate_fbm(noiseMap.data(), width, height, 0, 0, fbm, noise);
+        for (int i = 0; i < width * height; i++)
+            worldHeights[i] = ease_height(noiseMap[i], meshHeight, waterHeight);
+        face_cross_normals(worldHeights, width, height, normals);
+        benchmarkSink = normals[0];
+    }, 20);
+
+    normals.resize(width * height * 3);
+    double analyticNs = time_ns([&] {
+        generate_fbm_derivatives(pool, noiseMap.data(), dx.data(), dy.data(), width, height, 0, 0, fbm, noise);
+        for (int i = 0; i < width * height; i++)
+            eased_normal(noiseMap[i], dx[i], dy[i], meshHeight, waterHeight, &normals[i*3]);
+        benchmarkSink = normals[0];
+    }, 20);
+
+    // Against central differences of finely spaced heights, on land where the surface is smooth
+    const float h = 1.0f / 64;
+    double maxAngle = 0;
+    for (int y = 0; y < height; y += 7)
+        for (int x = 0; x < width; x += 7) {
+            float slopes[2];
+            for (int axis = 0; axis < 2; axis++) {
+                float heights[2];
+                for (int side = 0; side < 2; side++) {
+                    float offset = side ? h : -h;
+                    float value = 0;
+                    for (int i = 0; i < fbm.count; i++)
+                        value += perlin_noise_2d((x + (axis == 0 ? offset : 0)) / fbm.noiseScale * fbm.freq[i],
+                                                 (y + (axis == 1 ? offset : 0)) / fbm.noiseScale * fbm.freq[i], noise.perm()) * fbm.amp[i];
+                    heights[side] = ease_height((value + 1) / fbm.maxPossibleHeight, meshHeight, waterHeight);
+                }
+                slopes[axis] = (heights[1] - heights[0]) / (2 * h);
+            }
+            if (ease_height(noiseMap[x + y*width], meshHeight, waterHeight) <= waterHeight * 0.5 * meshHeight + 0.01f)
+                continue;
+
+            float length = std::sqrt(slopes[0]*slopes[0] + 1 + slopes[1]*slopes[1]);
+            const float *n = &normals[(x + y*width) * 3];
+            float cosine = (-slopes[0] * n[0] + n[1] - slopes[1] * n[2]) / length;
+            maxAngle = std::fmax(maxAngle, std::acos(std::fmin(cosine, 1.0f)) * 180 / M_PI);
+        }
+
+    // Right edge normals against the left edge of the next chunk over
+    generate_fbm_derivatives(pool, neighbourMap.data(), neighbourDx.data(), neighbourDy.data(), width, height, width-1, 0, fbm, noise);
+    long seamMismatches = 0;
+    for (int y = 0; y < height; y++) {
+        float a[3], b[3];
+        eased_normal(noiseMap[width-1 + y*width], dx[width-1 + y*width], dy[width-1 + y*width], meshHeight, waterHeight, a);
+        eased_normal(neighbourMap[y*width], neighbourDx[y*width], neighbourDy[y*width], meshHeight, waterHeight, b);
+        seamMismatches += a[0] != b[0] || a[1] != b[1] || a[2] != b[2];
+    }
+
+    printf("== normals: one 127x127 chunk with normals, one thread ==\n");
+    printf("heights + face cross normals  %7.3f ms/chunk\n", faceNs / 1e6);
+    printf("analytic normals              %7.3f ms/chunk\n", analyticNs / 1e6);
+    printf("analytic vs finite difference: max %.3f degrees, seam mismatches %ld\n", maxAngle, seamMismatches);
+
+    // Analytic heights follow the precision and evaluation settings, against generate_fbm() with the same ones
+    std::vector<float> expected(width * height);
+    for (NoisePrecision precision : { SINGLE_PRECISION, DOUBLE_PRECISION })
+        for (NoiseEvaluation evaluation : { LATTICE_CELLS, PER_SAMPLE }) {
+            FbmParams mode = params;
+            mode.precision = precision;
+            mode.evaluation = evaluation;
+            FbmOctaves modeFbm = get_fbm_octaves(mode);
+            double ns = time_ns([&] {
+                generate_fbm_derivatives(pool, noiseMap.data(), dx.data(), dy.data(), width, height, 0, 0, modeFbm, noise);
+                benchmarkSink = noiseMap[0];
+            }, 20);
+            generate_fbm(expected.data(), width, height, 0, 0, modeFbm, noise);
+            float maxDiff = 0;
+            for (int i = 0; i < width * height; i++)
+                maxDiff = std::fmax(maxDiff, std::fabs(noiseMap[i] - expected[i]));
+            printf("  %s %-12s derivatives %7.3f ms/chunk, heights off by %.2g\n",
+                   precision == SINGLE_PRECISION ? "float " : "double", evaluation == LATTICE_CELLS ? "cells" : "per sample", ns / 1e6, maxDiff);
+        }
+    generate_fbm_derivatives(pool, noiseMap.data(), dx.data(), dy.data(), width, height, 0, 0, fbm, noise);
+
+    // Central differences of the mesh's own heights, against the analytic normals above
+    const int apronWidth = width + 2, apronHeight = height + 2;
+    std::vector<float> apron(apronWidth * apronHeight), neighbourApron(apronWidth * apronHeight), central(width * height * 3);
+    double centralNs = time_ns([&] {
+        generate_fbm(apron.data(), apronWidth, apronHeight, -1, -1, fbm, noise);
+        central_difference_normals(apron.data(), width, height, meshHeight, waterHeight, [&](int y, const float *nx, const float *ny, const float *nz) {
+            for (int x = 0; x < width; x++) {
+                central[(x + y*width) * 3]     = nx[x];
+                central[(x + y*width) * 3 + 1] = ny[x];
+                central[(x + y*width) * 3 + 2] = nz[x];
+            }
+        });
+        benchmarkSink = central[0];
+    }, 20);
+
+    double maxCentralAngle = 0, meanCentralAngle = 0;
+    int landVertices = 0;
+    for (int i = 0; i < width * height; i++) {
+        if (ease_height(noiseMap[i], meshHeight, waterHeight) <= waterHeight * 0.5 * meshHeight + 0.01f)
+            continue;
+        float cosine = central[i*3] * normals[i*3] + central[i*3 + 1] * normals[i*3 + 1] + central[i*3 + 2] * normals[i*3 + 2];
+        double angle = std::acos(std::fmin(cosine, 1.0f)) * 180 / M_PI;
+        maxCentralAngle = std::fmax(maxCentralAngle, angle);
+        meanCentralAngle += angle;
+        landVertices++;
+    }
+
+    // Right edge against the left edge of the next chunk over, both from their own apron
+    generate_fbm(neighbourApron.data(), apronWidth, apronHeight, width-2, -1, fbm, noise);
+    std::vector<float> neighbourLeft(height * 3);
+    central_difference_normals(neighbourApron.data(), width, height, meshHeight, waterHeight, [&](int y, const float *nx, const float *ny, const float *nz) {
+        neighbourLeft[y*3] = nx[0];
+        neighbourLeft[y*3 + 1] = ny[0];
+        neighbourLeft[y*3 + 2] = nz[0];
+    });
+    long centralSeamMismatches = 0;
+    for (int y = 0; y < height; y++)
+        for (int i = 0; i < 3; i++)
+            centralSeamMismatches += central[(width-1 + y*width) * 3 + i] != neighbourLeft[y*3 + i];
+
+    printf("central difference normals    %7.3f ms/chunk\n", centralNs / 1e6);
+    printf("central difference vs analytic: mean %.3f, max %.3f degrees, seam mismatches %ld\n",
+           meanCentralAngle / landVertices, maxCentralAngle, centralSeamMismatches);
+
+    // Area weighted smooth normals, on one thread and split across every core
+    std::vector<float> smooth(width * height * 3), neighbourSmooth(width * height * 3);
+    auto store = [&](std::vector<float> &out) {
+        return [&out, width](int y, const float *nx, const float *ny, const float *nz) {
+            for (int x = 0; x < width; x++) {
+                out[(x + y*width) * 3]     = nx[x];
+                out[(x + y*width) * 3 + 1] = ny[x];
+                out[(x + y*width) * 3 + 2] = nz[x];
+            }
+        };
+    };
+    ThreadPool wide(std::thread::hardware_concurrency());
+    double smoothNs[2];
+    ThreadPool *pools[2] = { &pool, &wide };
+    for (int i = 0; i < 2; i++)
+        smoothNs[i] = time_ns([&] {
+            generate_fbm_parallel(*pools[i], apron.data(), apronWidth, apronHeight, -1, -1, fbm, noise);
+            area_weighted_normals(*pools[i], apron.data(), width, height, meshHeight, waterHeight, store(smooth));
+            benchmarkSink = smooth[0];
+        }, 20);
+
+    // Neighbour split over a different number of threads, so its rows fall in different bands
+    ThreadPool three(3);
+    area_weighted_normals(three, neighbourApron.data(), width, height, meshHeight, waterHeight, store(neighbourSmooth));
+    long smoothSeamMismatches = 0;
+    for (int y = 0; y < height; y++)
+        for (int i = 0; i < 3; i++)
+            smoothSeamMismatches += smooth[(width-1 + y*width) * 3 + i] != neighbourSmooth[(y*width) * 3 + i];
+
+    double meanSmoothAngle = 0;
+    for (int i = 0; i < width * height; i++) {
+        float cosine = smooth[i*3] * central[i*3] + smooth[i*3 + 1] * central[i*3 + 1] + smooth[i*3 + 2] * central[i*3 + 2];
+        meanSmoothAngle += std::acos(std::fmin(cosine, 1.0f)) * 180 / M_PI;
+    }
+
+    printf("area weighted normals         %7.3f ms/chunk, %.3f ms/chunk on %d threads\n", smoothNs[0] / 1e6, smoothNs[1] / 1e6, wide.size());
+    printf("area weighted vs central difference: mean %.3f degrees, seam mismatches %ld\n",
+           meanSmoothAngle / (width * height), smoothSeamMismatches);
+}
+
+struct Normal {
+    float x, y, z;
+};
+
+// Central difference normals and a 2x2 box downsample against one heightfield layout
+// Returns the time of each pass and a checksum of their output, which every layout should agree on
+template <typename Layout>
+void bench_layout(const char *name, const std::vector<float> &rowMajor, int width, int height, double checksum[2]) {
+    Heightfield<Layout> heights(rowMajor.data(), width, height);
+    Heightfield<Layout, Normal> normals(width, height);
+    Heightfield<Layout> mip(width / 2 + 1, height / 2 + 1);
+
+    double normalsNs = time_ns([&] {
+        for_each_sample(heights, [&](int x, int y) {
+            float left  = heights.at(x > 0 ? x-1 : x, y), right = heights.at(x < width-1  ? x+1 : x, y);
+            float below = heights.at(x, y > 0 ? y-1 : y), above = heights.at(x, y < height-1 ? y+1 : y);
+            float nx = left - right, ny = 2, nz = below - above;
+            float length = std::sqrt(nx*nx + ny*ny + nz*nz);
+            normals.at(x, y) = Normal{ nx / length, ny / length, nz / length };
+        });
+        benchmarkSink = normals.at(0, 0).y;
+    }, 20);
+
+    double mipNs = time_ns([&] {
+        for_each_sample(mip, [&](int x, int y) {
+            int x0 = std::min(2*x, width-1),  x1 = std::min(2*x + 1, width-1);
+            int y0 = std::min(2*y, height-1), y1 = std::min(2*y + 1, height-1);
+            mip.at(x, y) = (heights.at(x0, y0) + heights.at(x1, y0) + heights.at(x0, y1) + heights.at(x1, y1)) * 0.25f;
+        });
+        benchmarkSink = mip.at(0, 0);
+    }, 20);
+
+    checksum[0] = checksum[1] = 0;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            checksum[0] += normals.at(x, y).x + normals.at(x, y).z;
+    for (int y = 0; y < mip.height(); y++)
+        for (int x = 0; x < mip.width(); x++)
+            checksum[1] += mip.at(x, y);
+
+    printf("%5d  %-10s  %9.1f  %9.1f  %8.1f  %.6g %.6g\n", width, name, normalsNs / 1e3, mipNs / 1e3,
+           Layout::storage_size(width, height) * sizeof(float) / 1024.0, checksum[0], checksum[1]);
+}
+
+void bench_layouts() {
+    const int widths[] = { 127, 255, 511 };
+    FbmParams params = DEFAULT_FBM;
+    FbmOctaves fbm = get_fbm_octaves(params);
+    NoiseContext noise;
+
+    printf("== layouts: central difference normals and 2x2 downsample per heightfield layout ==\n");
+    printf("width  layout      normals us  downsample us  KiB      checksums\n");
+    for (int width : widths) {
+        std::vector<float> heights(width * width);
+        generate_fbm(heights.data(), width, width, 0, 0, fbm, noise);
+
+        double checksum[2];
+        bench_layout<RowMajorLayout>("row-major", heights, width, width, checksum);
+        bench_layout<TiledLayout<8>>("tiled 8", heights, width, width, checksum);
+        bench_layout<TiledLayout<32>>("tiled 32", heights, width, width, checksum);
+        bench_layout<MortonLayout>("morton", heights, width, width, checksum);
+    }
+}
+
+// Each triangle of a list or of -1 separated strips with its corners rotated to start at the lowest index, sorted
+// Two index lists with the same result draw the same triangles with the same winding
+std::vector<std::tuple<int, int, int>> canonical_triangles(const std::vector<int> &indices, bool strips) {
+    std::vector<std::tuple<int, int, int>> triangles;
+    auto add = [&](int a, int b, int c) {
+        if (b < a && b < c)
+            triangles.emplace_back(b, c, a);
+        else if (c < a && c < b)
+            triangles.emplace_back(c, a, b);
+        else
+            triangles.emplace_back(a, b, c);
+    };
+    if (!strips) {
+        for (int i = 0; i + 2 < (int)indices.size(); i += 3)
+            add(indices[i], indices[i+1], indices[i+2]);
+    } else {
+        int start = 0;
+        for (int i = 0; i < (int)indices.size(); i++) {
+            if (indices[i] < 0) {
+                start = i + 1;
+            } else if (i - start >= 2) {
+                if ((i - start) % 2 == 0)
+                    add(indices[i-2], indices[i-1], indices[i]);
+                else
+                    add(indices[i-1], indices[i-2], indices[i]);
+            }
+        }
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+// Indexed version of an obj model the way load_model() merges its corners,
+// one vertex per distinct position, normal and material
+std::vector<int> load_model_indices(const char *filename, int &vertexCount) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename);
+
+    std::map<std::tuple<int, int, int>, int> vertices;
+    std::vector<int> indices;
+    for (const tinyobj::shape_t &shape : shapes)
+        for (size_t i = 0; i < shape.mesh.indices.size(); i++) {
+            tinyobj::index_t idx = shape.mesh.indices[i];
+            auto key = std::make_tuple(idx.vertex_index, idx.normal_index, shape.mesh.material_ids[i / 3]);
+            auto found = vertices.emplace(key, (int)vertices.size()).first;
+            indices.push_back(found->second);
+        }
+    vertexCount = vertices.size();
+    return indices;
+}
+
+void bench_cache() {
+    const int width = 127, height = 127;
+    const int triangles = (width - 1) * (height - 1) * 2;
+    const int cacheSizes[] = { 16, 24, 32 };
+
+    printf("== cache: ACMR of a 127x127 chunk and the plant models on a FIFO post-transform cache ==\n");
+    printf("order                 indices   cache 16  cache 24  cache 32\n");
+    std::vector<int> rowMajor = generate_grid_indices(width, height, width - 1);
+    auto sameTriangles = canonical_triangles(rowMajor, false);
+    auto report = [&](const char *name, const std::vector<int> &indices, int count, bool strips) {
+        printf("%-20s  %7d", name, (int)indices.size());
+        for (int cacheSize : cacheSizes)
+            printf("  %8.3f", simulate_acmr(indices, count, cacheSize));
+        printf("%s\n", strips || count != triangles || canonical_triangles(indices, strips) == sameTriangles ? "" : "  different triangles");
+    };
+    report("row-major list", rowMajor, triangles, false);
+    report("row-major strips", generate_grid_strip_indices(width, height, width - 1), triangles, true);
+    for (int window : { 6, 7, 8, 10, 14 }) {
+        char name[32];
+        std::vector<int> strips = generate_grid_strip_indices(width, height, window);
+        snprintf(name, sizeof(name), "window %d list", window);
+        report(name, generate_grid_indices(width, height, window), triangles, false);
+        snprintf(name, sizeof(name), "window %d strips", window);
+        report(name, strips, triangles, true);
+        if (canonical_triangles(strips, true) != sameTriangles)
+            printf("window %d strips draw different triangles\n", window);
+    }
+    report("forsyth list", optimize_vertex_cache(rowMajor, width * height), triangles, false);
+
+    const char *models[] = { "obj/CommonTree_1.obj", "obj/Flowers.obj" };
+    for (const char *model : models) {
+        int vertexCount;
+        std::vector<int> indices = load_model_indices(model, vertexCount);
+        if (indices.empty()) {
+            printf("%s not found, run from the repository root\n", model);
+            continue;
+        }
+        std::vector<int> optimized;
+        double forsythNs = time_ns([&] { optimized = optimize_vertex_cache(indices, vertexCount); }, 5);
+        printf("%s: %d vertices, %d triangles, forsyth %.2f ms\n", model, vertexCount, (int)indices.size() / 3, forsythNs / 1e6);
+        std::vector<int> sorted = indices, sortedOptimized = optimized;
+        std::sort(sorted.begin(), sorted.end());
+        std::sort(sortedOptimized.begin(), sortedOptimized.end());
+        report("  obj order", indices, indices.size() / 3, false);
+        report("  forsyth", optimized, optimized.size() / 3, sorted != sortedOptimized);
+    }
+}
+
+// Triangles of every level of detail, and checks that stitched sides draw exactly the coarser neighbour's edge
+// segments and that every index set still covers the whole chunk once
+void bench_lod() {
+    const int width = 127, height = 127, window = 6;
+
+    printf("== lod: geomipmapped 127x127 chunk ==\n");
+    printf("level  stride  triangles  ACMR 16\n");
+    for (int level = 0; level < LOD_LEVELS; level++) {
+        std::vector<int> indices = generate_lod_indices(width, height, 1 << level, 0, window);
+        printf("%5d  %6d  %9d  %7.3f\n", level, 1 << level, (int)indices.size() / 3, simulate_acmr(indices, indices.size() / 3, 16));
+    }
+    printf("level 0 matches generate_grid_indices(): %s\n", generate_lod_indices(width, height, 1, 0, window) == generate_grid_indices(width, height, window) ? "yes" : "no");
+
+    // Twice the area of a triangle on the xz grid, positive for the winding of generate_grid_indices()
+    auto area = [&](int a, int b, int c) {
+        int ax = a % width, ay = a / width;
+        return (b % width - ax) * (c / width - ay) - (b / width - ay) * (c % width - ax);
+    };
+    // Edges of a set along one side of the chunk
+    auto side_edges = [&](const std::vector<int> &indices, int side) {
+        auto on_side = [&](int v) {
+            int x = v % width, y = v / width;
+            return side == LOD_LEFT ? x == 0 : side == LOD_RIGHT ? x == width - 1 : side == LOD_BOTTOM ? y == 0 : y == height - 1;
+        };
+        std::vector<std::pair<int, int>> edges;
+        for (size_t t = 0; t < indices.size(); t += 3)
+            for (int i = 0; i < 3; i++) {
+                int a = indices[t + i], b = indices[t + (i + 1) % 3];
+                if (on_side(a) && on_side(b))
+                    edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        std::sort(edges.begin(), edges.end());
+        return edges;
+    };
+
+    int badCoverage = 0, badSides = 0;
+    for (int level = 0; level < LOD_LEVELS; level++)
+        for (int mask = 0; mask < LOD_STITCH_MASKS; mask++) {
+            std::vector<int> indices = generate_lod_indices(width, height, 1 << level, mask, window);
+            long covered = 0;
+            bool flipped = false;
+            for (size_t t = 0; t < indices.size(); t += 3) {
+                int twiceArea = area(indices[t], indices[t + 1], indices[t + 2]);
+                covered += twiceArea;
+                flipped |= twiceArea <= 0;
+            }
+            badCoverage += flipped || covered != 2L * (width - 1) * (height - 1);
+
+            if (level == LOD_LEVELS - 1)
+                continue;
+            std::vector<int> coarser = generate_lod_indices(width, height, 2 << level, 0, window);
+            for (int side : { LOD_LEFT, LOD_RIGHT, LOD_BOTTOM, LOD_TOP })
+                if (mask & side)
+                    badSides += side_edges(indices, side) != side_edges(coarser, side);
+        }
+    printf("index sets with gaps or overlaps: %d of %d, stitched sides not matching the next level: %d\n",
+           badCoverage, LOD_LEVELS * LOD_STITCH_MASKS, badSides);
+
+    // main.cpp stores each level's interior once and its border parts for every stitch of their own sides
+    int badParts = 0, badStrips = 0;
+    long fullListIndices = 0, partIndices = 0, partStripIndices = 0;
+    for (int level = 0; level < LOD_LEVELS; level++) {
+        std::vector<int> interior = generate_lod_indices(width, height, 1 << level, 0, window, 0);
+        std::vector<int> interiorStrips = generate_lod_interior_strip_indices(width, height, 1 << level, window);
+        badStrips += canonical_triangles(interiorStrips, true) != canonical_triangles(interior, false)
+                  || (int)interior.size() / 3 != lod_interior_triangles(width, height, 1 << level);
+        partIndices += interior.size();
+        partStripIndices += interiorStrips.size();
+
+        for (int mask = 0; mask < LOD_STITCH_MASKS; mask++) {
+            std::vector<int> full = generate_lod_indices(width, height, 1 << level, mask, window), parts = interior;
+            fullListIndices += full.size();
+            for (int part = 0; part < LOD_BORDER_PARTS; part++) {
+                int sides = LOD_BORDER_SIDES[part];
+                std::vector<int> border = generate_lod_indices(width, height, 1 << level, mask & sides, window, sides);
+                parts.insert(parts.end(), border.begin(), border.end());
+                if ((mask & ~sides) == 0) {
+                    partIndices += border.size();
+                    partStripIndices += border.size();
+                }
+            }
+            badParts += canonical_triangles(parts, false) != canonical_triangles(full, false);
+        }
+    }
+    printf("interior and border parts not matching the full set: %d, interior strips not matching the list: %d\n", badParts, badStrips);
+    printf("16-bit index memory, every level: %ld bytes as full lists per stitch mask, %ld as parts, %ld with interior strips\n",
+           fullListIndices * 2, partIndices * 2, partStripIndices * 2);
+
+    // Terrain triangles in render distance with the camera at the center of a large world, levels as main.cpp picks them
+    const int chunks = 41, center = chunks / 2;
+    const float lodDistance = 0.5f * (width - 1);
+    std::vector<int> levels(chunks * chunks);
+    for (int y = 0; y < chunks; y++)
+        for (int x = 0; x < chunks; x++) {
+            float dx = std::max(std::abs(x - center) - 0.5f, 0.0f) * (width - 1), dy = std::max(std::abs(y - center) - 0.5f, 0.0f) * (height - 1);
+            levels[x + y*chunks] = select_lod_level(std::sqrt(dx*dx + dy*dy), lodDistance);
+        }
+    limit_lod_steps(levels, chunks, chunks);
+    int counts[LOD_LEVELS][LOD_STITCH_MASKS];
+    for (int level = 0; level < LOD_LEVELS; level++)
+        for (int mask = 0; mask < LOD_STITCH_MASKS; mask++)
+            counts[level][mask] = generate_lod_indices(width, height, 1 << level, mask, window).size() / 3;
+
+    printf("render distance  full triangles  lod triangles\n");
+    for (int distance : { 1, 2, 3, 5, 8, 12, 20 }) {
+        long full = 0, lod = 0;
+        for (int y = center - distance; y <= center + distance; y++)
+            for (int x = center - distance; x <= center + distance; x++) {
+                full += counts[0][0];
+                lod += counts[levels[x + y*chunks]][lod_stitch_mask(levels, x, y, chunks, chunks)];
+            }
+        printf("%15d  %14ld  %13ld\n", distance, full, lod);
+    }
+}
+
+// Heap traffic of the chunk passes once every thread's arena is warm, the scratch of fBm rows, multi-rate noise
+// and normals all comes from chunk_arena()
+void bench_arena() {
+    const int width = 127, height = 127, apronWidth = width + 2, apronHeight = height + 2;
+    const float meshHeight = 32, waterHeight = 0.1f;
+    NoiseContext noise;
+    FbmOctaves fbm = get_fbm_octaves(DEFAULT_FBM);
+    FbmMultiRate plan = plan_fbm_multirate(fbm, 4, 0.01f);
+    ThreadPool pool(3);
+    std::vector<float> apron(apronWidth * apronHeight), noiseMap(width * height), dx(width * height), dy(width * height);
+
+    auto chunk = [&](int i) {
+        int originX = (i % 10) * (width - 1), originY = (i / 10) * (height - 1);
+        generate_fbm_parallel(pool, apron.data(), apronWidth, apronHeight, originX - 1, originY - 1, fbm, noise);
+        area_weighted_normals(pool, apron.data(), width, height, meshHeight, waterHeight, [&](int, const float *nx, const float *, const float *) {
+            benchmarkSink = nx[0];
+        });
+        central_difference_normals(apron.data(), width, height, meshHeight, waterHeight, [&](int, const float *nx, const float *, const float *) {
+            benchmarkSink = nx[0];
+        });
+        generate_fbm_multirate(pool, noiseMap.data(), width, height, originX, originY, fbm, plan, noise);
+        generate_fbm_derivatives(pool, noiseMap.data(), dx.data(), dy.data(), width, height, originX, originY, fbm, noise);
+    };
+
+    // The first row of chunks warms up the arenas of every thread
+    for (int i = 0; i < 10; i++)
+        chunk(i);
+    size_t allocations = heap_allocations();
+    int i = 10;
+    double ns = time_ns([&] { chunk(i++ % 100); }, 40);
+    allocations = heap_allocations() - allocations;
+
+    printf("== arena: apron fBm, area weighted and central difference normals, multi-rate fBm and derivatives of a 127x127 chunk, %d threads ==\n", pool.size());
+    printf("%7.3f ms/chunk, %.2f heap allocations/chunk, %zu arena blocks\n", ns / 1e6, (double)allocations / 41, ChunkArena::heap_blocks());
+}
+
+// Geometry clipmap of 6 levels of 127x127: triangles drawn, the hole positions a moving camera needs,
+// samples generated as it moves, and how far level heights are from the finer level's at the same place
+void bench_clipmap() {
+    const int gridSize = 127, levels = 6, size = gridSize + 2, window = 6;
+    const int firstHole = clipmap_first_hole(gridSize);
+
+    printf("== clipmap: %d levels of %dx%d ==\n", levels, gridSize, gridSize);
+    long triangles = generate_clipmap_indices(gridSize, -1, -1, window).size() / 3;
+    triangles += (levels - 1) * (generate_clipmap_indices(gridSize, firstHole, firstHole, window).size() / 3);
+    printf("%ld triangles every frame, reaching %d samples from the camera\n", triangles, (1 << (levels - 1)) * (gridSize - 1) / 2);
+
+    // Camera wandering in straight lines at 0.5 to 8 samples per frame, tracking which sample every texel holds
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> angle(0, 6.2831853f), speed(0.5f, 8);
+    std::vector<std::vector<int>> texels(levels, std::vector<int>(size * size * 2));
+    std::vector<int> regionX(levels), regionY(levels);
+    float x = 0, y = 0, dirX = 0, dirY = 0, step = 0;
+    int frames = 20000, badHoles = 0, badTexels = 0;
+    long generated = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        if (frame % 200 == 0) {
+            float a = angle(rng);
+            dirX = std::cos(a);
+            dirY = std::sin(a);
+            step = speed(rng);
+        }
+        x += dirX * step;
+        y += dirY * step;
+
+        for (int level = 0; level < levels; level++) {
+            int originX = clipmap_origin(x, level, gridSize), originY = clipmap_origin(y, level, gridSize);
+            if (level > 0) {
+                int holeX = clipmap_hole(originX, clipmap_origin(x, level - 1, gridSize));
+                int holeY = clipmap_hole(originY, clipmap_origin(y, level - 1, gridSize));
+                badHoles += holeX < firstHole || holeX >= firstHole + CLIPMAP_HOLE_OFFSETS
+                         || holeY < firstHole || holeY >= firstHole + CLIPMAP_HOLE_OFFSETS;
+            }
+
+            std::vector<int> &t = texels[level];
+            for (const ClipmapRegion &region : clipmap_update_regions(frame > 0, regionX[level], regionY[level], originX - 1, originY - 1, size))
+                split_toroidal(region, size, [&](const ClipmapRegion &part) {
+                    for (int j = part.y; j < part.y + part.height; j++)
+                        for (int i = part.x; i < part.x + part.width; i++) {
+                            int texel = clipmap_texel(i, size) + clipmap_texel(j, size) * size;
+                            t[texel * 2] = i;
+                            t[texel * 2 + 1] = j;
+                            generated++;
+                        }
+                });
+            regionX[level] = originX - 1;
+            regionY[level] = originY - 1;
+
+            for (int j = regionY[level]; j < regionY[level] + size; j++)
+                for (int i = regionX[level]; i < regionX[level] + size; i++) {
+                    int texel = clipmap_texel(i, size) + clipmap_texel(j, size) * size;
+                    badTexels += t[texel * 2] != i || t[texel * 2 + 1] != j;
+                }
+        }
+    }
+    printf("hole positions outside the %dx%d rings: %d, texels holding the wrong sample: %d\n",
+           CLIPMAP_HOLE_OFFSETS, CLIPMAP_HOLE_OFFSETS, badHoles, badTexels);
+    printf("%.0f samples generated per frame, %d for a full refresh\n", (double)generated / frames, levels * size * size);
+
+    // Every sample of a level is an even sample of the level inside it
+    NoiseContext noise;
+    FbmOctaves fbm = get_fbm_octaves(DEFAULT_FBM);
+    std::vector<float> coarse(size * size), fine(size * size * 4);
+    for (int level = 1; level < levels; level++) {
+        FbmOctaves coarseFbm = get_clipmap_octaves(fbm, level), fineFbm = get_clipmap_octaves(fbm, level - 1);
+        generate_fbm(coarse.data(), size, size, -size / 2, -size / 2, coarseFbm, noise);
+        generate_fbm(fine.data(), size * 2, size * 2, -size / 2 * 2, -size / 2 * 2, fineFbm, noise);
+        float maxError = 0;
+        for (int j = 0; j < size; j++)
+            for (int i = 0; i < size; i++)
+                maxError = std::max(maxError, std::fabs(coarse[i + j*size] - fine[i*2 + j*2 * size*2]));
+        printf("level %d: largest difference from level %d at the same sample %g\n", level, level - 1, maxError);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::string section = argc > 1 ? argv[1] : "all";
+
+    if (section == "all" || section == "simd")
+        bench_simd();
+    if (section == "all" || section == "2d")
+        bench_2d();
+    if (section == "all" || section == "fbm")
+        bench_fbm();
+    if (section == "all" || section == "worlds")
+        bench_worlds();
+    if (section == "all" || section == "parallel")
+        bench_parallel();
+    if (section == "all" || section == "precision")
+        bench_precision();
+    if (section == "all" || section == "backends")
+        bench_backends();
+    if (section == "all" || section == "cells")
+        bench_cells();
+    if (section == "all" || section == "detail")
+        bench_detail();
+    if (section == "all" || section == "edges")
+        bench_edges();
+    if (section == "all" || section == "seams")
+        bench_seams();
+    if (section == "all" || section == "multirate")
+        bench_multirate();
+    if (section == "all" || section == "normals")
+        bench_normals();
+    if (section == "all" || section == "layouts")
+        bench_layouts();
+    if (section == "all" || section == "cache")
+        bench_cache();
+    if (section == "all" || section == "lod")
+        bench_lod();
+    if (section == "all" || section == "arena")
+        bench_arena();
+    if (section == "all" || section == "clipmap")
+        bench_clipmap();
+
+    return 0;
+}
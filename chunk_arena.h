@@ -0,0 +1,122 @@
+#ifndef CHUNK_ARENA_H
+#define CHUNK_ARENA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for chunk generation scratch, one per thread, see chunk_arena()
+// Memory is only given back by rewinding to an earlier mark, everything allocated since goes at once
+// Blocks come from the global heap, and are kept across rewinds so a warmed up arena never goes back to it
+class ChunkArena : public std::pmr::memory_resource {
+public:
+    struct Mark {
+        size_t block;
+        size_t offset;
+    };
+
+    ChunkArena() = default;
+    ChunkArena(const ChunkArena &) = delete;
+    ChunkArena &operator=(const ChunkArena &) = delete;
+
+    ~ChunkArena() {
+        for (Block &block : blocks)
+            std::pmr::new_delete_resource()->deallocate(block.data, block.size, alignof(std::max_align_t));
+    }
+
+    Mark mark() const { return Mark{ current, offset }; }
+
+    // Frees everything allocated after m
+    // Back at the start, an arena that needed more than one block swaps them for one big enough for all of them
+    void rewind(Mark m) {
+        current = m.block;
+        offset = m.offset;
+        if (current == 0 && offset == 0 && blocks.size() > 1)
+            coalesce();
+    }
+
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Block &block : blocks)
+            total += block.size;
+        return total;
+    }
+
+    // Blocks taken from the global heap by every arena so far
+    static size_t heap_blocks() { return heapBlocks.load(std::memory_order_relaxed); }
+
+protected:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        while (true) {
+            if (current < blocks.size()) {
+                uintptr_t base = (uintptr_t)blocks[current].data;
+                size_t start = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+                if (start + bytes <= blocks[current].size) {
+                    offset = start + bytes;
+                    return blocks[current].data + start;
+                }
+                current++;
+                offset = 0;
+                continue;
+            }
+            add_block(std::max(bytes + alignment, std::max(MIN_BLOCK_SIZE, capacity())));
+        }
+    }
+
+    // Freed by rewinding
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+
+    static constexpr size_t MIN_BLOCK_SIZE = 64 * 1024;
+    static inline std::atomic<size_t> heapBlocks{0};
+
+    std::vector<Block> blocks;
+    size_t current = 0;  // Block being bumped
+    size_t offset = 0;   // Bytes used of it
+
+    void add_block(size_t size) {
+        blocks.push_back(Block{ (char *)std::pmr::new_delete_resource()->allocate(size, alignof(std::max_align_t)), size });
+        heapBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void coalesce() {
+        size_t total = capacity();
+        for (Block &block : blocks)
+            std::pmr::new_delete_resource()->deallocate(block.data, block.size, alignof(std::max_align_t));
+        blocks.clear();
+        add_block(total);
+    }
+};
+
+ChunkArena &chunk_arena() {
+    thread_local ChunkArena arena;
+    return arena;
+}
+
+// Scratch memory from this thread's arena, everything allocated through it while it's alive is freed when it goes
+// Declare it before the containers using it, they're destroyed first
+class ArenaScope {
+public:
+    ArenaScope() : arena(chunk_arena()), start(arena.mark()) {}
+    ~ArenaScope() { arena.rewind(start); }
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+    std::pmr::memory_resource *resource() { return &arena; }
+
+private:
+    ChunkArena &arena;
+    ChunkArena::Mark start;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef CHUNK_EDGES_H
+#define CHUNK_EDGES_H
+
+#include <algorithm>
+#include <vector>
+
+#include "fbm.h"
+#include "noise_context.h"
+#include "thread_pool.h"
+
+const int MAX_EDGE_CHANNELS = 3;  // Heights and their two partial derivatives
+
+enum ChunkEdge {
+    LEFT_EDGE,    // Columns -apron to apron
+    RIGHT_EDGE,   // Columns width-1 - apron to width-1 + apron
+    BOTTOM_EDGE,  // Rows -apron to apron
+    TOP_EDGE      // Rows height-1 - apron to height-1 + apron
+};
+
+// Samples of a chunk no generated neighbour shares, [firstX, lastX) x [firstY, lastY) in chunk coordinates
+struct ChunkRect {
+    int firstX, lastX;
+    int firstY, lastY;
+};
+
+// Samples near the sides of every chunk generated so far in a grid of chunks overlapping by one sample
+// With an apron of a samples, columns -a to a of a chunk are columns width-1 - a to width-1 + a of the chunk to its left,
+// so each side keeps a strip 2a + 1 samples across, over the side's length and apron, for every channel
+// A chunk copies the strips it shares with generated neighbours instead of evaluating them again,
+// so seams are bit-identical by construction, even between chunks generated at different detail
+// Chunks are generated one at a time, the rows of one chunk can be fetched and stored from several threads
+// Chunks outside the grid are neither fetched for nor recorded, a 0 x 0 grid caches nothing
+class ChunkEdgeCache {
+public:
+    ChunkEdgeCache(int _chunksX, int _chunksY, int _width, int _height, int _apron = 0, int _channels = 1)
+        : chunksX(_chunksX), chunksY(_chunksY), width(_width), height(_height), apron(_apron), channels(_channels),
+          edges(_chunksX * _chunksY * _channels * strips_size()), generated(_chunksX * _chunksY, false) {}
+
+    int apron_size() const { return apron; }
+
+    ChunkRect uncached(int chunkX, int chunkY) const {
+        ChunkRect rect = { -apron, width + apron, -apron, height + apron };
+        if (is_generated(chunkX - 1, chunkY))
+            rect.firstX = apron + 1;
+        if (is_generated(chunkX + 1, chunkY))
+            rect.lastX = std::max(rect.firstX, width - 1 - apron);
+        if (is_generated(chunkX, chunkY - 1))
+            rect.firstY = apron + 1;
+        if (is_generated(chunkX, chunkY + 1))
+            rect.lastY = std::max(rect.firstY, height - 1 - apron);
+        return rect;
+    }
+
+    // Copies the samples of chunk row y shared with generated neighbours, rows[channel] starts at column -apron
+    void fetch_row(int chunkX, int chunkY, int y, float *const *rows) const {
+        const int lines = 2 * apron + 1;
+        bool left = is_generated(chunkX - 1, chunkY), right = is_generated(chunkX + 1, chunkY);
+        bool bottom = y <= apron && is_generated(chunkX, chunkY - 1),
+             top    = y >= height - 1 - apron && is_generated(chunkX, chunkY + 1);
+
+        for (int c = 0; c < channels; c++) {
+            for (int line = 0; line < lines && left; line++)
+                rows[c][line] = edge(chunkX - 1, chunkY, RIGHT_EDGE, c)[line * column_length() + y + apron];
+            for (int line = 0; line < lines && right; line++)
+                rows[c][width - 1 + line] = edge(chunkX + 1, chunkY, LEFT_EDGE, c)[line * column_length() + y + apron];
+            if (bottom) {
+                const float *line = edge(chunkX, chunkY - 1, TOP_EDGE, c) + (y + apron) * row_length();
+                std::copy(line, line + row_length(), rows[c]);
+            }
+            if (top) {
+                const float *line = edge(chunkX, chunkY + 1, BOTTOM_EDGE, c) + (y - (height - 1 - apron)) * row_length();
+                std::copy(line, line + row_length(), rows[c]);
+            }
+        }
+    }
+
+    // Records the samples of chunk row y its neighbours will share, laid out as in fetch_row()
+    void store_row(int chunkX, int chunkY, int y, const float *const *rows) {
+        if (!in_grid(chunkX, chunkY))
+            return;
+
+        const int lines = 2 * apron + 1;
+        for (int c = 0; c < channels; c++) {
+            for (int line = 0; line < lines; line++) {
+                edge(chunkX, chunkY, LEFT_EDGE, c)[line * column_length() + y + apron]  = rows[c][line];
+                edge(chunkX, chunkY, RIGHT_EDGE, c)[line * column_length() + y + apron] = rows[c][width - 1 + line];
+            }
+            if (y <= apron)
+                std::copy(rows[c], rows[c] + row_length(), edge(chunkX, chunkY, BOTTOM_EDGE, c) + (y + apron) * row_length());
+            if (y >= height - 1 - apron)
+                std::copy(rows[c], rows[c] + row_length(), edge(chunkX, chunkY, TOP_EDGE, c) + (y - (height - 1 - apron)) * row_length());
+        }
+    }
+
+    // fetch_row() and store_row() for every row of a block stride samples across, blocks[channel] starts at row and column -apron
+    void fetch_block(int chunkX, int chunkY, float *const *blocks, int stride) const {
+        for (int y = -apron; y < height + apron; y++) {
+            float *rows[MAX_EDGE_CHANNELS];
+            for (int c = 0; c < channels; c++)
+                rows[c] = blocks[c] + (y + apron) * stride;
+            fetch_row(chunkX, chunkY, y, rows);
+        }
+    }
+
+    void store_block(int chunkX, int chunkY, const float *const *blocks, int stride) {
+        for (int y = -apron; y < height + apron; y++) {
+            const float *rows[MAX_EDGE_CHANNELS];
+            for (int c = 0; c < channels; c++)
+                rows[c] = blocks[c] + (y + apron) * stride;
+            store_row(chunkX, chunkY, y, rows);
+        }
+    }
+
+    // Marks a chunk generated once every row is stored, its neighbours can fetch from it from then on
+    void finish(int chunkX, int chunkY) {
+        if (!in_grid(chunkX, chunkY))
+            return;
+
+        ChunkRect rect = uncached(chunkX, chunkY);
+        savedSamples += (long)row_length() * column_length() - (long)(rect.lastX - rect.firstX) * (rect.lastY - rect.firstY);
+        generated[chunkX + chunkY * chunksX] = true;
+    }
+
+    // Samples copied from neighbours instead of evaluated, per channel
+    long saved_samples() const { return savedSamples; }
+
+private:
+    int chunksX, chunksY;
+    int width, height;
+    int apron;
+    int channels;
+    std::vector<float> edges;  // Left, right, bottom then top strip of each channel of each chunk
+    std::vector<bool> generated;
+    long savedSamples = 0;
+
+    int row_length() const { return width + 2 * apron; }
+    int column_length() const { return height + 2 * apron; }
+    int strips_size() const { return (2 * apron + 1) * 2 * (row_length() + column_length()); }
+
+    bool in_grid(int chunkX, int chunkY) const {
+        return chunkX >= 0 && chunkX < chunksX && chunkY >= 0 && chunkY < chunksY;
+    }
+
+    bool is_generated(int chunkX, int chunkY) const {
+        return in_grid(chunkX, chunkY) && generated[chunkX + chunkY * chunksX];
+    }
+
+    // Strip lines one after another, columns for the left and right sides, rows for the bottom and top
+    float *edge(int chunkX, int chunkY, ChunkEdge side, int channel) {
+        return const_cast<float *>(static_cast<const ChunkEdgeCache *>(this)->edge(chunkX, chunkY, side, channel));
+    }
+
+    const float *edge(int chunkX, int chunkY, ChunkEdge side, int channel) const {
+        const int lines = 2 * apron + 1;
+        const float *strips = &edges[((chunkX + chunkY * chunksX) * channels + channel) * strips_size()];
+        switch (side) {
+            case LEFT_EDGE:   return strips;
+            case RIGHT_EDGE:  return strips + lines * column_length();
+            case BOTTOM_EDGE: return strips + 2 * lines * column_length();
+            default:          return strips + 2 * lines * column_length() + lines * row_length();
+        }
+    }
+};
+
+// generate_fbm_parallel() for one chunk of a grid, only evaluating the samples no generated neighbour shares
+// Chunk (chunkX, chunkY) must start at (originX, originY) = (chunkX, chunkY) * (size - 1), the cache has no apron
+void generate_fbm_chunk(ThreadPool &pool, ChunkEdgeCache &edgeCache, int chunkX, int chunkY, float *out, int width, int height,
+                        int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    float *blocks[1] = { out };
+    edgeCache.fetch_block(chunkX, chunkY, blocks, width);
+
+    ChunkRect rect = edgeCache.uncached(chunkX, chunkY);
+    pool.parallel_for(rect.lastY - rect.firstY, [&](int begin, int end) {
+        generate_fbm_block(out, width, rect.firstX, rect.lastX, rect.firstY + begin, rect.firstY + end,
+                           originX, originY, fbm, noise);
+    });
+
+    edgeCache.store_block(chunkX, chunkY, blocks, width);
+    edgeCache.finish(chunkX, chunkY);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef CHUNK_SEAMS_H
+#define CHUNK_SEAMS_H
+
+#include <algorithm>
+#include <climits>
+
+#include "fbm.h"
+
+// Octaves for chunks of a grid overlapping by one sample, when neighbours can keep different octave counts
+// Every sample within one of a chunk's side, its apron included, is also generated by the chunk across that side,
+// as a border vertex or as apron. Those samples take the octaves of whichever chunk sharing them keeps the most,
+// so every chunk generating one gets the same height and derivatives, and central differences and area weighted
+// normals read the same heights on both sides of a seam. The step to the chunk's own octaves falls inside the chunk,
+// where it's at most the height quantum the truncation allowed. See 'benchmark seams'
+
+// Octaves of each band of a chunk's samples, [bandY][bandX]
+// Band 0 is the apron before the first sample and the first two samples, 2 the last two and the apron after them
+struct ChunkSeamOctaves {
+    FbmOctaves bands[3][3];
+    bool uniform;  // Every band has the chunk's own octaves
+};
+
+// Seam octaves of chunk (chunkX, chunkY), chunkOctaves(x, y) gives the octaves any chunk keeps on its own
+// Chunks only differ by how many octaves they truncate, so the most octaves are also the finest
+template <typename ChunkOctaves>
+ChunkSeamOctaves get_seam_octaves(int chunkX, int chunkY, ChunkOctaves chunkOctaves) {
+    ChunkSeamOctaves seams;
+    FbmOctaves own = chunkOctaves(chunkX, chunkY);
+    seams.uniform = true;
+
+    for (int bandY = 0; bandY < 3; bandY++)
+        for (int bandX = 0; bandX < 3; bandX++) {
+            FbmOctaves finest = own;
+            for (int dy = std::min(bandY - 1, 0); dy <= std::max(bandY - 1, 0); dy++)
+                for (int dx = std::min(bandX - 1, 0); dx <= std::max(bandX - 1, 0); dx++) {
+                    FbmOctaves neighbour = chunkOctaves(chunkX + dx, chunkY + dy);
+                    if (neighbour.count > finest.count)
+                        finest = neighbour;
+                }
+            seams.bands[bandY][bandX] = finest;
+            seams.uniform = seams.uniform && finest.count == own.count;
+        }
+
+    return seams;
+}
+
+// Calls generate(fbm, firstX, lastX, firstY, lastY) for every block of the samples [firstX, lastX) x [firstY, lastY)
+// of a width x height chunk that share their octaves, in chunk coordinates, the apron is -1 and width or height
+// A uniform chunk is one block
+template <typename Generate>
+void for_each_seam_block(const ChunkSeamOctaves &seams, int width, int height, int firstX, int lastX, int firstY, int lastY,
+                         Generate generate) {
+    if (seams.uniform) {
+        generate(seams.bands[1][1], firstX, lastX, firstY, lastY);
+        return;
+    }
+
+    const int xStarts[4] = { INT_MIN, 2, width - 2, INT_MAX },
+              yStarts[4] = { INT_MIN, 2, height - 2, INT_MAX };
+    for (int bandY = 0; bandY < 3; bandY++) {
+        int blockFirstY = std::max(firstY, yStarts[bandY]), blockLastY = std::min(lastY, yStarts[bandY + 1]);
+        if (blockFirstY >= blockLastY)
+            continue;
+        for (int bandX = 0; bandX < 3; bandX++) {
+            int blockFirstX = std::max(firstX, xStarts[bandX]), blockLastX = std::min(lastX, xStarts[bandX + 1]);
+            if (blockFirstX < blockLastX)
+                generate(seams.bands[bandY][bandX], blockFirstX, blockLastX, blockFirstY, blockLastY);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef CLIPMAP_H
+#define CLIPMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "fbm.h"
+#include "vertex_cache.h"
+
+// Geometry clipmaps: nested n x n grids centered on the camera, each level with twice the vertex spacing of the
+// one inside it, so the same triangles cover the whole view however far it reaches
+// Level l puts vertex (i, j) on noise sample (origin + i, origin + j) of a grid with spacing 2^l. Origins are kept
+// even, so every vertex of a level is also a sample of the level inside it, and the grid of level l - 1 exactly
+// fills a hole of (n - 1) / 2 squares in level l. The hole moves by at most a few squares around the middle,
+// so every position it can take has its own ring of indices, see 'benchmark clipmap'
+// Heights live in toroidal textures of (n + 2) x (n + 2) samples, with one sample of apron for normals.
+// Moving the camera only generates the rows and columns of samples that came into range
+
+const int CLIPMAP_HOLE_OFFSETS = 4;  // Hole positions along each axis a ring has indices for
+
+// Origin along one axis of level l, in samples of that level, for the camera at noise sample position
+int clipmap_origin(float position, int level, int gridSize) {
+    float levelPosition = position / (1 << level);
+    return 2 * (int)std::floor((levelPosition - (gridSize - 1) / 2.0f) / 2);
+}
+
+// Lowest square of the hole that the level inside a level with origin coarseOrigin leaves, for the given finer origin
+int clipmap_hole(int coarseOrigin, int fineOrigin) {
+    return fineOrigin / 2 - coarseOrigin;
+}
+
+// Lowest hole position a ring has indices for, the others follow it
+int clipmap_first_hole(int gridSize) {
+    return (gridSize - 1) / 4 - 1;
+}
+
+// Triangle list of a gridSize x gridSize level, like generate_grid_indices(), leaving out the (gridSize - 1) / 2
+// squares across starting at square (holeX, holeY), or no hole when holeX is negative
+std::vector<int> generate_clipmap_indices(int gridSize, int holeX, int holeY, int window) {
+    std::vector<int> grid = generate_grid_indices(gridSize, gridSize, window);
+    if (holeX < 0)
+        return grid;
+
+    int holeSize = (gridSize - 1) / 2;
+    std::vector<int> indices;
+    indices.reserve(grid.size() - holeSize * holeSize * 6);
+    for (size_t t = 0; t < grid.size(); t += 6) {
+        // Bottom left vertex of the square, see generate_grid_indices()
+        int x = grid[t + 1] % gridSize, y = grid[t + 1] / gridSize;
+        if (x >= holeX && x < holeX + holeSize && y >= holeY && y < holeY + holeSize)
+            continue;
+        indices.insert(indices.end(), grid.begin() + t, grid.begin() + t + 6);
+    }
+    return indices;
+}
+
+// Octaves sampling level l, same frequencies over a noise scale 2^l times smaller so sample i falls where the
+// finest level's sample i * 2^l does
+FbmOctaves get_clipmap_octaves(const FbmOctaves &fbm, int level) {
+    FbmOctaves levelFbm = fbm;
+    levelFbm.noiseScale = fbm.noiseScale / (1 << level);
+    for (int i = 0; i < fbm.count; i++)
+        levelFbm.walkCells[i] = fbm.walkCells[i] && levelFbm.freq[i] / levelFbm.noiseScale <= MAX_CELL_WALK_STEP;
+    return levelFbm;
+}
+
+// Rectangle of samples of a level
+struct ClipmapRegion {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// Samples of the size x size region starting at (newX, newY) that the one starting at (oldX, oldY) didn't have,
+// the columns that came in over the full new height and then the rows over the full new width
+// Everything when there was no old region or the two don't overlap
+std::vector<ClipmapRegion> clipmap_update_regions(bool valid, int oldX, int oldY, int newX, int newY, int size) {
+    std::vector<ClipmapRegion> regions;
+    if (!valid || std::abs(newX - oldX) >= size || std::abs(newY - oldY) >= size) {
+        regions.push_back(ClipmapRegion{ newX, newY, size, size });
+        return regions;
+    }
+
+    if (newX > oldX)
+        regions.push_back(ClipmapRegion{ oldX + size, newY, newX - oldX, size });
+    else if (newX < oldX)
+        regions.push_back(ClipmapRegion{ newX, newY, oldX - newX, size });
+    if (newY > oldY)
+        regions.push_back(ClipmapRegion{ newX, oldY + size, size, newY - oldY });
+    else if (newY < oldY)
+        regions.push_back(ClipmapRegion{ newX, newY, size, oldY - newY });
+    return regions;
+}
+
+// Texel of sample i in a toroidal texture of the given size
+int clipmap_texel(int i, int size) {
+    return ((i % size) + size) % size;
+}
+
+// Splits a region of at most size x size samples where it wraps around the toroidal texture,
+// fn(part) gets up to 4 regions that each land on one contiguous block of texels
+template <typename Fn>
+void split_toroidal(const ClipmapRegion &region, int size, Fn fn) {
+    int splitX = std::min(region.width,  size - clipmap_texel(region.x, size));
+    int splitY = std::min(region.height, size - clipmap_texel(region.y, size));
+    int xs[3] = { region.x, region.x + splitX, region.x + region.width };
+    int ys[3] = { region.y, region.y + splitY, region.y + region.height };
+    for (int j = 0; j < 2; j++)
+        for (int i = 0; i < 2; i++)
+            if (xs[i + 1] > xs[i] && ys[j + 1] > ys[j])
+                fn(ClipmapRegion{ xs[i], ys[j], xs[i + 1] - xs[i], ys[j + 1] - ys[j] });
+}
+
+#endif
@@ -0,0 +1,446 @@
+#ifndef FBM_H
+#define FBM_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "chunk_arena.h"
+#include "perlin.h"
+#include "perlin_simd.h"
+#include "noise_backend.h"
+#include "noise_context.h"
+#include "thread_pool.h"
+
+const int MAX_OCTAVES = 16;
+
+// Single precision runs the noise at twice the SIMD width
+enum NoisePrecision {
+    DOUBLE_PRECISION,
+    SINGLE_PRECISION
+};
+
+// Lattice cell walking hoists the corner hashes out of runs of samples sharing a cell
+// Octaves sampled coarser than MAX_CELL_WALK_STEP lattice units per sample stay on the batch kernels,
+// where too few samples share a cell to pay for the per cell setup
+enum NoiseEvaluation {
+    PER_SAMPLE,
+    LATTICE_CELLS
+};
+
+const float MAX_CELL_WALK_STEP = 1.0f / 8;
+
+struct FbmParams {
+    int octaves;
+    float noiseScale;   // Horizontal scaling
+    float persistence;  // Decrease in amplitude of octaves
+    float lacunarity;   // Increase in frequency of octaves
+    NoisePrecision precision;
+    NoiseBackend backend;
+    NoiseEvaluation evaluation;
+};
+
+// Per octave amplitude and frequency, computed once per chunk instead of per sample
+struct FbmOctaves {
+    int count;
+    int firstOctave;  // Octaves below this one are left out, see generate_fbm_multirate()
+    float noiseScale;
+    NoisePrecision precision;
+    NoiseBackend backend;
+    const NoiseKernels *kernels;
+    float amp[MAX_OCTAVES];
+    float freq[MAX_OCTAVES];
+    bool walkCells[MAX_OCTAVES];
+    float maxPossibleHeight;
+};
+
+FbmOctaves get_fbm_octaves(const FbmParams &params) {
+    FbmOctaves fbm = {};
+    fbm.count = std::min(params.octaves, MAX_OCTAVES);
+    fbm.noiseScale = params.noiseScale;
+    fbm.precision = params.precision;
+    fbm.backend = params.backend;
+    fbm.kernels = &get_noise_kernels(params.backend);
+
+    float amp  = 1;
+    float freq = 1;
+    for (int i = 0; i < fbm.count; i++) {
+        fbm.amp[i]  = amp;
+        fbm.freq[i] = freq;
+        fbm.walkCells[i] = params.evaluation == LATTICE_CELLS && fbm.kernels->row != nullptr
+                        && freq / params.noiseScale <= MAX_CELL_WALK_STEP;
+        fbm.maxPossibleHeight += amp;
+        amp  *= params.persistence;
+        freq *= params.lacunarity;
+    }
+
+    return fbm;
+}
+
+// Detail asked for by one generation request, far chunks can ask for less
+struct FbmDetail {
+    int octaveBudget;     // Most octaves to evaluate, 0 for no limit
+    float heightQuantum;  // Smallest normalized height step the target LOD can show, 0 keeps every octave
+};
+
+// Drops the finest octaves a request can't show
+// maxPossibleHeight stays that of the full set, so the octaves that are kept give the same heights in every chunk
+// and neighbours generated at different detail only differ by the octaves one of them dropped
+FbmOctaves truncate_fbm_octaves(const FbmOctaves &fbm, const FbmDetail &detail) {
+    FbmOctaves truncated = fbm;
+    if (detail.octaveBudget > 0)
+        truncated.count = std::min(truncated.count, detail.octaveBudget);
+
+    // Noise stays within -1 to 1, so the dropped octaves move a height by at most the sum of their amplitudes,
+    // starting with the ones the budget already dropped
+    float dropped = 0;
+    for (int i = truncated.count; i < fbm.count; i++)
+        dropped += std::fabs(fbm.amp[i]) / fbm.maxPossibleHeight;
+    while (truncated.count > 1) {
+        dropped += std::fabs(fbm.amp[truncated.count - 1]) / fbm.maxPossibleHeight;
+        if (dropped >= detail.heightQuantum)
+            break;
+        truncated.count--;
+    }
+
+    return truncated;
+}
+
+// Sample x coordinates of every octave for columns [firstColumn, lastColumn) of a block starting at originX
+// They only depend on the column and octave, so a block computes them once and every row reads them
+// Built from the full octave set, they also serve any truncation of it, see truncate_fbm_octaves()
+struct FbmColumns {
+    int firstColumn;
+    int lastColumn;
+    std::pmr::vector<float> xs;  // One run of columns per octave
+
+    FbmColumns(int _firstColumn, int _lastColumn, int originX, const FbmOctaves &fbm, std::pmr::memory_resource *resource)
+        : firstColumn(_firstColumn), lastColumn(_lastColumn), xs(fbm.count * (_lastColumn - _firstColumn), resource) {
+        int n = lastColumn - firstColumn;
+        for (int i = fbm.firstOctave; i < fbm.count; i++)
+            for (int x = 0; x < n; x++)
+                xs[i*n + x] = (x + firstColumn + originX) / fbm.noiseScale * fbm.freq[i];
+    }
+
+    // Octave i's sample x coordinates from column x on
+    const float *octave(int i, int x) const { return &xs[i * (lastColumn - firstColumn) + x - firstColumn]; }
+};
+
+// Per row scratch of the row generators, for rows of up to n samples
+struct FbmRowScratch {
+    std::pmr::vector<float> ys;
+    std::pmr::vector<double> values;
+    std::pmr::vector<float> valuesF;
+    std::pmr::vector<double> dx, dy;
+    std::pmr::vector<float> dxF, dyF;
+
+    FbmRowScratch(int n, std::pmr::memory_resource *resource)
+        : ys(n, resource), values(n, resource), valuesF(n, resource), dx(n, resource), dy(n, resource), dxF(n, resource), dyF(n, resource) {}
+};
+
+// The kernels of one backend in one precision as direct calls, for the octave loops specialized at compile time
+// Backends without a row kernel leave out row(), only Perlin has derivatives
+template <NoiseBackend Backend, NoisePrecision Precision>
+struct FbmKernel;
+
+template <>
+struct FbmKernel<PERLIN_BACKEND, SINGLE_PRECISION> {
+    static const bool HAS_ROW = true;
+    static float *values(FbmRowScratch &scratch) { return &scratch.valuesF[0]; }
+    static float *dx(FbmRowScratch &scratch) { return &scratch.dxF[0]; }
+    static float *dy(FbmRowScratch &scratch) { return &scratch.dyF[0]; }
+    static void batch(const float *x, const float *y, float *out, int n, const int *p) { perlin_noise_2d_batch_f(x, y, out, n, p); }
+    static void row(const float *x, float y, float *out, int n, const int *p) { perlin_noise_2d_row_f(x, y, out, n, p); }
+    static void batch_derivatives(const float *x, const float *y, float *out, float *dx, float *dy, int n, const int *p) {
+        perlin_noise_2d_batch_derivatives_f(x, y, out, dx, dy, n, p);
+    }
+    static void row_derivatives(const float *x, float y, float *out, float *dx, float *dy, int n, const int *p) {
+        perlin_noise_2d_row_derivatives_f(x, y, out, dx, dy, n, p);
+    }
+};
+
+template <>
+struct FbmKernel<PERLIN_BACKEND, DOUBLE_PRECISION> {
+    static const bool HAS_ROW = true;
+    static double *values(FbmRowScratch &scratch) { return &scratch.values[0]; }
+    static double *dx(FbmRowScratch &scratch) { return &scratch.dx[0]; }
+    static double *dy(FbmRowScratch &scratch) { return &scratch.dy[0]; }
+    static void batch(const float *x, const float *y, double *out, int n, const int *p) { perlin_noise_2d_batch(x, y, out, n, p); }
+    static void row(const float *x, float y, double *out, int n, const int *p) { perlin_noise_2d_row(x, y, out, n, p); }
+    static void batch_derivatives(const float *x, const float *y, double *out, double *dx, double *dy, int n, const int *p) {
+        perlin_noise_2d_batch_derivatives(x, y, out, dx, dy, n, p);
+    }
+    static void row_derivatives(const float *x, float y, double *out, double *dx, double *dy, int n, const int *p) {
+        perlin_noise_2d_row_derivatives(x, y, out, dx, dy, n, p);
+    }
+};
+
+template <>
+struct FbmKernel<SIMPLEX_BACKEND, SINGLE_PRECISION> {
+    static const bool HAS_ROW = false;
+    static float *values(FbmRowScratch &scratch) { return &scratch.valuesF[0]; }
+    static void batch(const float *x, const float *y, float *out, int n, const int *p) { simplex_noise_2d_batch_f(x, y, out, n, p); }
+};
+
+template <>
+struct FbmKernel<SIMPLEX_BACKEND, DOUBLE_PRECISION> {
+    static const bool HAS_ROW = false;
+    static double *values(FbmRowScratch &scratch) { return &scratch.values[0]; }
+    static void batch(const float *x, const float *y, double *out, int n, const int *p) { simplex_noise_2d_batch(x, y, out, n, p); }
+};
+
+// Fills out[0, lastColumn - firstColumn) with the fBm heights of columns [firstColumn, lastColumn) of grid row y,
+// origin included, normalized to range from 0 to 1
+void generate_fbm_row(float *out, const FbmColumns &columns, int firstColumn, int lastColumn, int y,
+                      const FbmOctaves &fbm, const NoiseContext &noise, FbmRowScratch &scratch) {
+    const int n = lastColumn - firstColumn;
+    std::fill(out, out + n, 0.0f);
+
+    for (int i = fbm.firstOctave; i < fbm.count; i++) {
+        const float *xs = columns.octave(i, firstColumn);
+        float ySample = y / fbm.noiseScale * fbm.freq[i];
+        if (!fbm.walkCells[i])
+            std::fill(&scratch.ys[0], &scratch.ys[0] + n, ySample);
+
+        if (fbm.precision == SINGLE_PRECISION) {
+            if (fbm.walkCells[i])
+                fbm.kernels->rowF(xs, ySample, &scratch.valuesF[0], n, noise.perm());
+            else
+                fbm.kernels->batchF(xs, &scratch.ys[0], &scratch.valuesF[0], n, noise.perm());
+            for (int x = 0; x < n; x++)
+                out[x] += scratch.valuesF[x] * fbm.amp[i];
+        } else {
+            if (fbm.walkCells[i])
+                fbm.kernels->row(xs, ySample, &scratch.values[0], n, noise.perm());
+            else
+                fbm.kernels->batch(xs, &scratch.ys[0], &scratch.values[0], n, noise.perm());
+            for (int x = 0; x < n; x++)
+                out[x] += scratch.values[x] * fbm.amp[i];
+        }
+    }
+
+    // Inverse lerp and scale values to range from 0 to 1
+    for (int x = 0; x < n; x++)
+        out[x] = (out[x] + 1) / fbm.maxPossibleHeight;
+}
+
+// generate_fbm_row() for exactly Octaves octaves from the first, with the backend and precision fixed at compile time
+// The octave loop has a constant trip count and calls the noise kernels directly, so the compiler can unroll it
+template <int Octaves, NoiseBackend Backend, NoisePrecision Precision>
+void generate_fbm_row_fixed(float *out, const FbmColumns &columns, int firstColumn, int lastColumn, int y,
+                            const FbmOctaves &fbm, const NoiseContext &noise, FbmRowScratch &scratch) {
+    typedef FbmKernel<Backend, Precision> Kernel;
+    const int n = lastColumn - firstColumn;
+    auto *values = Kernel::values(scratch);
+    std::fill(out, out + n, 0.0f);
+
+    for (int i = 0; i < Octaves; i++) {
+        const float *xs = columns.octave(i, firstColumn);
+        float ySample = y / fbm.noiseScale * fbm.freq[i];
+        if (Kernel::HAS_ROW && fbm.walkCells[i]) {
+            if constexpr (Kernel::HAS_ROW)
+                Kernel::row(xs, ySample, values, n, noise.perm());
+        } else {
+            std::fill(&scratch.ys[0], &scratch.ys[0] + n, ySample);
+            Kernel::batch(xs, &scratch.ys[0], values, n, noise.perm());
+        }
+        for (int x = 0; x < n; x++)
+            out[x] += values[x] * fbm.amp[i];
+    }
+
+    for (int x = 0; x < n; x++)
+        out[x] = (out[x] + 1) / fbm.maxPossibleHeight;
+}
+
+// generate_fbm_row() specialized for octave sets of Octaves octaves, other sets take the runtime loop
+// The output is bit-identical either way, so Octaves only decides the speed, 0 always takes the runtime loop
+template <int Octaves>
+void generate_fbm_row(float *out, const FbmColumns &columns, int firstColumn, int lastColumn, int y,
+                      const FbmOctaves &fbm, const NoiseContext &noise, FbmRowScratch &scratch) {
+    if constexpr (Octaves > 0) {
+        if (fbm.count == Octaves && fbm.firstOctave == 0) {
+            if (fbm.backend == PERLIN_BACKEND && fbm.precision == SINGLE_PRECISION)
+                return generate_fbm_row_fixed<Octaves, PERLIN_BACKEND, SINGLE_PRECISION>(out, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+            if (fbm.backend == PERLIN_BACKEND && fbm.precision == DOUBLE_PRECISION)
+                return generate_fbm_row_fixed<Octaves, PERLIN_BACKEND, DOUBLE_PRECISION>(out, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+            if (fbm.backend == SIMPLEX_BACKEND && fbm.precision == SINGLE_PRECISION)
+                return generate_fbm_row_fixed<Octaves, SIMPLEX_BACKEND, SINGLE_PRECISION>(out, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+            if (fbm.backend == SIMPLEX_BACKEND && fbm.precision == DOUBLE_PRECISION)
+                return generate_fbm_row_fixed<Octaves, SIMPLEX_BACKEND, DOUBLE_PRECISION>(out, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+        }
+    }
+    generate_fbm_row(out, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+}
+
+// Fills columns [firstColumn, lastColumn) of rows [firstRow, lastRow) of a width x height block of fBm heights
+// normalized to range from 0 to 1, sampled at the integer grid points starting at (originX, originY)
+// Scratch comes from the thread's chunk arena, so generating rows one call at a time doesn't touch the heap
+// Octave sets of Octaves octaves take the compile-time loop, see generate_fbm_row_fixed()
+template <int Octaves = 0>
+void generate_fbm_block(float *out, int width, int firstColumn, int lastColumn, int firstRow, int lastRow,
+                        int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    ArenaScope scratch;
+    FbmColumns columns(firstColumn, lastColumn, originX, fbm, scratch.resource());
+    FbmRowScratch rowScratch(lastColumn - firstColumn, scratch.resource());
+
+    for (int y = firstRow; y < lastRow; y++)
+        generate_fbm_row<Octaves>(out + y*width + firstColumn, columns, firstColumn, lastColumn, y + originY, fbm, noise, rowScratch);
+}
+
+// Fills rows [firstRow, lastRow) of a width x height block, see generate_fbm_block()
+void generate_fbm_rows(float *out, int width, int firstRow, int lastRow, int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    generate_fbm_block(out, width, 0, width, firstRow, lastRow, originX, originY, fbm, noise);
+}
+
+void generate_fbm(float *out, int width, int height, int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    generate_fbm_rows(out, width, 0, height, originX, originY, fbm, noise);
+}
+
+// generate_fbm() with the octave count and block size fixed at compile time, see generate_fbm_row_fixed()
+// Octave sets of another size take the runtime loop, so the noise settings can still be tuned while running
+template <int Octaves, int Width, int Height>
+void generate_fbm(float *out, int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    ArenaScope scratch;
+    FbmColumns columns(0, Width, originX, fbm, scratch.resource());
+    FbmRowScratch rowScratch(Width, scratch.resource());
+
+    for (int y = 0; y < Height; y++)
+        generate_fbm_row<Octaves>(out + y*Width, columns, 0, Width, y + originY, fbm, noise, rowScratch);
+}
+
+// Same output as generate_fbm(), with the rows split across the pool
+// Every row is computed exactly as in the serial path, so the result is bit-identical
+void generate_fbm_parallel(ThreadPool &pool, float *out, int width, int height, int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    pool.parallel_for(height, [&](int firstRow, int lastRow) {
+        generate_fbm_rows(out, width, firstRow, lastRow, originX, originY, fbm, noise);
+    });
+}
+
+// generate_fbm_row() that also writes the partial derivatives of each height per world unit along x and y
+// Perlin backend only, octaves follow the same precision and evaluation as in generate_fbm_row(),
+// so heights match it up to rounding
+void generate_fbm_derivative_row(float *out, float *dxOut, float *dyOut, const FbmColumns &columns, int firstColumn, int lastColumn,
+                                 int y, const FbmOctaves &fbm, const NoiseContext &noise, FbmRowScratch &scratch) {
+    const int n = lastColumn - firstColumn;
+    std::fill(out, out + n, 0.0f);
+    std::fill(dxOut, dxOut + n, 0.0f);
+    std::fill(dyOut, dyOut + n, 0.0f);
+
+    for (int i = fbm.firstOctave; i < fbm.count; i++) {
+        const float *xs = columns.octave(i, firstColumn);
+        float ySample = y / fbm.noiseScale * fbm.freq[i];
+        if (!fbm.walkCells[i])
+            std::fill(&scratch.ys[0], &scratch.ys[0] + n, ySample);
+
+        // Chain rule through the sample coordinates
+        float scale = fbm.amp[i] * fbm.freq[i] / fbm.noiseScale;
+        if (fbm.precision == SINGLE_PRECISION) {
+            if (fbm.walkCells[i])
+                perlin_noise_2d_row_derivatives_f(xs, ySample, &scratch.valuesF[0], &scratch.dxF[0], &scratch.dyF[0], n, noise.perm());
+            else
+                perlin_noise_2d_batch_derivatives_f(xs, &scratch.ys[0], &scratch.valuesF[0], &scratch.dxF[0], &scratch.dyF[0], n, noise.perm());
+            for (int x = 0; x < n; x++) {
+                out[x] += scratch.valuesF[x] * fbm.amp[i];
+                dxOut[x] += scratch.dxF[x] * scale;
+                dyOut[x] += scratch.dyF[x] * scale;
+            }
+        } else {
+            if (fbm.walkCells[i])
+                perlin_noise_2d_row_derivatives(xs, ySample, &scratch.values[0], &scratch.dx[0], &scratch.dy[0], n, noise.perm());
+            else
+                perlin_noise_2d_batch_derivatives(xs, &scratch.ys[0], &scratch.values[0], &scratch.dx[0], &scratch.dy[0], n, noise.perm());
+            for (int x = 0; x < n; x++) {
+                out[x] += scratch.values[x] * fbm.amp[i];
+                dxOut[x] += scratch.dx[x] * scale;
+                dyOut[x] += scratch.dy[x] * scale;
+            }
+        }
+    }
+
+    for (int x = 0; x < n; x++) {
+        out[x] = (out[x] + 1) / fbm.maxPossibleHeight;
+        dxOut[x] /= fbm.maxPossibleHeight;
+        dyOut[x] /= fbm.maxPossibleHeight;
+    }
+}
+
+// generate_fbm_derivative_row() for exactly Octaves octaves from the first, see generate_fbm_row_fixed()
+template <int Octaves, NoisePrecision Precision>
+void generate_fbm_derivative_row_fixed(float *out, float *dxOut, float *dyOut, const FbmColumns &columns, int firstColumn, int lastColumn,
+                                       int y, const FbmOctaves &fbm, const NoiseContext &noise, FbmRowScratch &scratch) {
+    typedef FbmKernel<PERLIN_BACKEND, Precision> Kernel;
+    const int n = lastColumn - firstColumn;
+    auto *values = Kernel::values(scratch);
+    auto *dx = Kernel::dx(scratch);
+    auto *dy = Kernel::dy(scratch);
+    std::fill(out, out + n, 0.0f);
+    std::fill(dxOut, dxOut + n, 0.0f);
+    std::fill(dyOut, dyOut + n, 0.0f);
+
+    for (int i = 0; i < Octaves; i++) {
+        const float *xs = columns.octave(i, firstColumn);
+        float ySample = y / fbm.noiseScale * fbm.freq[i];
+        if (fbm.walkCells[i]) {
+            Kernel::row_derivatives(xs, ySample, values, dx, dy, n, noise.perm());
+        } else {
+            std::fill(&scratch.ys[0], &scratch.ys[0] + n, ySample);
+            Kernel::batch_derivatives(xs, &scratch.ys[0], values, dx, dy, n, noise.perm());
+        }
+
+        float scale = fbm.amp[i] * fbm.freq[i] / fbm.noiseScale;
+        for (int x = 0; x < n; x++) {
+            out[x] += values[x] * fbm.amp[i];
+            dxOut[x] += dx[x] * scale;
+            dyOut[x] += dy[x] * scale;
+        }
+    }
+
+    for (int x = 0; x < n; x++) {
+        out[x] = (out[x] + 1) / fbm.maxPossibleHeight;
+        dxOut[x] /= fbm.maxPossibleHeight;
+        dyOut[x] /= fbm.maxPossibleHeight;
+    }
+}
+
+// generate_fbm_derivative_row() specialized for octave sets of Octaves octaves, see generate_fbm_row<Octaves>()
+template <int Octaves>
+void generate_fbm_derivative_row(float *out, float *dxOut, float *dyOut, const FbmColumns &columns, int firstColumn, int lastColumn,
+                                 int y, const FbmOctaves &fbm, const NoiseContext &noise, FbmRowScratch &scratch) {
+    if constexpr (Octaves > 0) {
+        if (fbm.count == Octaves && fbm.firstOctave == 0) {
+            if (fbm.precision == SINGLE_PRECISION)
+                return generate_fbm_derivative_row_fixed<Octaves, SINGLE_PRECISION>(out, dxOut, dyOut, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+            return generate_fbm_derivative_row_fixed<Octaves, DOUBLE_PRECISION>(out, dxOut, dyOut, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+        }
+    }
+    generate_fbm_derivative_row(out, dxOut, dyOut, columns, firstColumn, lastColumn, y, fbm, noise, scratch);
+}
+
+// generate_fbm_block() that also writes the partial derivatives of each height, see generate_fbm_derivative_row()
+template <int Octaves = 0>
+void generate_fbm_derivative_block(float *out, float *dxOut, float *dyOut, int width, int firstColumn, int lastColumn,
+                                   int firstRow, int lastRow, int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    ArenaScope scratch;
+    FbmColumns columns(firstColumn, lastColumn, originX, fbm, scratch.resource());
+    FbmRowScratch rowScratch(lastColumn - firstColumn, scratch.resource());
+
+    for (int y = firstRow; y < lastRow; y++) {
+        int row = y*width + firstColumn;
+        generate_fbm_derivative_row<Octaves>(out + row, dxOut + row, dyOut + row, columns, firstColumn, lastColumn, y + originY, fbm, noise, rowScratch);
+    }
+}
+
+// Fills rows [firstRow, lastRow) of a width x height block, see generate_fbm_derivative_block()
+void generate_fbm_derivative_rows(float *out, float *dxOut, float *dyOut, int width, int firstRow, int lastRow,
+                                  int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    generate_fbm_derivative_block(out, dxOut, dyOut, width, 0, width, firstRow, lastRow, originX, originY, fbm, noise);
+}
+
+void generate_fbm_derivatives(ThreadPool &pool, float *out, float *dxOut, float *dyOut, int width, int height,
+                              int originX, int originY, const FbmOctaves &fbm, const NoiseContext &noise) {
+    pool.parallel_for(height, [&](int firstRow, int lastRow) {
+        generate_fbm_derivative_rows(out, dxOut, dyOut, width, firstRow, lastRow, originX, originY, fbm, noise);
+    });
+}
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef FBM_MULTIRATE_H
+#define FBM_MULTIRATE_H
+
+#include <cmath>
+#include <vector>
+
+#include "chunk_arena.h"
+#include "fbm.h"
+#include "noise_context.h"
+#include "thread_pool.h"
+
+// Catmull-Rom upsampling of 2D Perlin noise sampled every h lattice units is off by at most about 3 h^3,
+// rounded up for margin, see 'benchmark multirate'
+const float CATMULL_ROM_NOISE_ERROR = 4;
+
+// Octaves summed on a coarse grid and upsampled, instead of evaluated at every vertex
+struct FbmMultiRate {
+    int stride;         // Vertices between coarse samples
+    int coarseOctaves;  // Octaves [0, coarseOctaves) run on the coarse grid
+};
+
+// Moves the lowest octaves to a grid with the given stride for as long as their summed upsampling error
+// stays under maxError, in normalized height units
+FbmMultiRate plan_fbm_multirate(const FbmOctaves &fbm, int stride, float maxError) {
+    FbmMultiRate plan = { stride, 0 };
+    float error = 0;
+    for (int i = 0; i < fbm.count - 1 && stride > 1; i++) {
+        float h = stride / fbm.noiseScale * fbm.freq[i];
+        error += std::fabs(fbm.amp[i]) / fbm.maxPossibleHeight * CATMULL_ROM_NOISE_ERROR * h * h * h;
+        if (error > maxError)
+            break;
+        plan.coarseOctaves = i + 1;
+    }
+    return plan;
+}
+
+// Weights of the 4 Catmull-Rom taps around a point t of the way between the middle two
+struct CatmullRomWeights {
+    int first;  // Index of the first tap
+    float w[4];
+};
+
+CatmullRomWeights catmull_rom_weights(int first, float t) {
+    float t2 = t * t, t3 = t2 * t;
+    return CatmullRomWeights{ first, { 0.5f * (-t3 + 2*t2 - t),
+                                       0.5f * (3*t3 - 5*t2 + 2),
+                                       0.5f * (-3*t3 + 4*t2 + t),
+                                       0.5f * (t3 - t2) } };
+}
+
+int floor_div(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+// Taps for each vertex [0, n) of a line starting at world index origin, with coarse samples every stride vertices
+// starting at world index firstNode * stride, allocated from the calling thread's chunk arena
+std::pmr::vector<CatmullRomWeights> get_upsample_weights(int n, int origin, int stride, int firstNode) {
+    std::pmr::vector<CatmullRomWeights> weights(n, &chunk_arena());
+    for (int i = 0; i < n; i++) {
+        int node = floor_div(origin + i, stride);
+        weights[i] = catmull_rom_weights(node - 1 - firstNode, (float)(origin + i - node * stride) / stride);
+    }
+    return weights;
+}
+
+// Same as generate_fbm_parallel() with the octaves in plan sampled every plan.stride vertices and upsampled
+// The coarse grid is anchored to world coordinates, so neighbouring chunks interpolate the same coarse samples
+// with the same weights and their shared edges still match exactly
+void generate_fbm_multirate(ThreadPool &pool, float *out, int width, int height, int originX, int originY,
+                            const FbmOctaves &fbm, const FbmMultiRate &plan, const NoiseContext &noise) {
+    if (plan.coarseOctaves == 0) {
+        generate_fbm_parallel(pool, out, width, height, originX, originY, fbm, noise);
+        return;
+    }
+
+    // Coarse grid covering the chunk plus the extra tap on each side
+    int firstNodeX = floor_div(originX, plan.stride) - 1,
+        firstNodeY = floor_div(originY, plan.stride) - 1;
+    int columns = floor_div(originX + width  - 1, plan.stride) + 3 - firstNodeX,
+        rows    = floor_div(originY + height - 1, plan.stride) + 3 - firstNodeY;
+
+    ArenaScope scratch;
+    FbmOctaves coarse = fbm;
+    coarse.count = plan.coarseOctaves;
+    coarse.noiseScale = fbm.noiseScale / plan.stride;
+    for (int i = 0; i < coarse.count; i++)
+        coarse.walkCells[i] = fbm.walkCells[i] && coarse.freq[i] / coarse.noiseScale <= MAX_CELL_WALK_STEP;
+    std::pmr::vector<float> coarseHeights(columns * rows, scratch.resource());
+    generate_fbm(coarseHeights.data(), columns, rows, firstNodeX, firstNodeY, coarse, noise);
+
+    // Upsample along x once for every coarse row, each band then only blends 4 of these rows per vertex row
+    std::pmr::vector<CatmullRomWeights> xWeights = get_upsample_weights(width,  originX, plan.stride, firstNodeX),
+                                        yWeights = get_upsample_weights(height, originY, plan.stride, firstNodeY);
+    std::pmr::vector<float> coarseRows(rows * width, scratch.resource());
+    for (int row = 0; row < rows; row++)
+        for (int x = 0; x < width; x++) {
+            const float *taps = &coarseHeights[row * columns + xWeights[x].first];
+            const float *w = xWeights[x].w;
+            coarseRows[row * width + x] = w[0]*taps[0] + w[1]*taps[1] + w[2]*taps[2] + w[3]*taps[3];
+        }
+
+    FbmOctaves fine = fbm;
+    fine.firstOctave = plan.coarseOctaves;
+
+    pool.parallel_for(height, [&](int firstRow, int lastRow) {
+        generate_fbm_rows(out, width, firstRow, lastRow, originX, originY, fine, noise);
+
+        // Both parts are normalized on their own, so one copy of the +1 offset comes back out
+        for (int y = firstRow; y < lastRow; y++) {
+            const float *taps = &coarseRows[yWeights[y].first * width];
+            const float *w = yWeights[y].w;
+            float *noiseHeights = out + y*width;
+            for (int x = 0; x < width; x++)
+                noiseHeights[x] += w[0]*taps[x] + w[1]*taps[width + x] + w[2]*taps[2*width + x] + w[3]*taps[3*width + x]
+                                 - 1 / fbm.maxPossibleHeight;
+        }
+    });
+}
+
+#endif
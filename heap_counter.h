@@ -0,0 +1,55 @@
+#ifndef HEAP_COUNTER_H
+#define HEAP_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Counts every allocation through the global operator new, to check that generating a chunk doesn't touch the heap
+// Replaces the global operators, over-aligned ones included, so include it from exactly one translation unit of a program
+std::atomic<size_t> globalHeapAllocations{0};
+
+size_t heap_allocations() {
+    return globalHeapAllocations.load(std::memory_order_relaxed);
+}
+
+// GCC sees the replacements pair new with std::free once they're inlined, which is what they're meant to do
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) {
+    globalHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// std::aligned_alloc wants a multiple of the alignment
+void *operator new(size_t size, std::align_val_t alignment) {
+    globalHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = (size_t)alignment;
+    size_t bytes = size ? (size + align - 1) / align * align : align;
+    if (void *p = std::aligned_alloc(align, bytes))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
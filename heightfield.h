@@ -0,0 +1,138 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <cstdint>
+#include <vector>
+
+// Memory layouts for a width x height grid of samples
+// Every layout here splits the storage index of (x, y) into a column part plus a row part,
+// so a grid can look both up from small tables instead of redoing the bit twiddling per access
+// See 'benchmark layouts' for how they compare on neighbour heavy passes
+
+// Rows one after another, what every std::vector<float> height buffer uses
+struct RowMajorLayout {
+    static int storage_size(int width, int height) { return width * height; }
+    static int column_offset(int x, int) { return x; }
+    static int row_offset(int y, int width) { return y * width; }
+};
+
+// Square tiles of Tile x Tile samples stored one after another, rows of tiles in order
+// Neighbours above and below are usually in the same tile instead of a whole row away
+template <int Tile>
+struct TiledLayout {
+    static int tiles_across(int width) { return (width + Tile - 1) / Tile; }
+    static int storage_size(int width, int height) { return tiles_across(width) * tiles_across(height) * Tile * Tile; }
+    static int column_offset(int x, int) { return (x / Tile) * Tile * Tile + x % Tile; }
+    static int row_offset(int y, int width) { return (y / Tile) * tiles_across(width) * Tile * Tile + (y % Tile) * Tile; }
+};
+
+// Z-order curve, the bits of x and y interleaved
+// Locality holds at every scale, at the cost of padding to a power of two square
+struct MortonLayout {
+    static int padded_side(int width, int height) {
+        int side = 1;
+        while (side < width || side < height)
+            side *= 2;
+        return side;
+    }
+    static int storage_size(int width, int height) { return padded_side(width, height) * padded_side(width, height); }
+    static int column_offset(int x, int) { return (int)spread_bits(x); }
+    static int row_offset(int y, int) { return (int)spread_bits(y) << 1; }
+
+    // Moves bit i of a 16-bit value to bit 2i
+    static uint32_t spread_bits(uint32_t v) {
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+};
+
+// Storage index of (x, y) from the column and row offset tables, row-major skips the tables
+template <typename Layout>
+struct LayoutIndex {
+    static int index(const std::vector<int> &columns, const std::vector<int> &rows, int x, int y, int) { return columns[x] + rows[y]; }
+};
+
+template <>
+struct LayoutIndex<RowMajorLayout> {
+    static int index(const std::vector<int> &, const std::vector<int> &, int x, int y, int width) { return x + y*width; }
+};
+
+// Grid of samples stored in Layout order, accessed by (x, y) like a row-major buffer
+template <typename Layout, typename T = float>
+class Heightfield {
+public:
+    Heightfield(int _width, int _height) : w(_width), h(_height), columns(_width), rows(_height), samples(Layout::storage_size(_width, _height)) {
+        for (int x = 0; x < w; x++)
+            columns[x] = Layout::column_offset(x, w);
+        for (int y = 0; y < h; y++)
+            rows[y] = Layout::row_offset(y, w);
+    }
+
+    // Copies a row-major buffer, such as the output of generate_fbm()
+    Heightfield(const T *rowMajor, int _width, int _height) : Heightfield(_width, _height) {
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                at(x, y) = rowMajor[x + y*w];
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    T &at(int x, int y) { return samples[LayoutIndex<Layout>::index(columns, rows, x, y, w)]; }
+    const T &at(int x, int y) const { return samples[LayoutIndex<Layout>::index(columns, rows, x, y, w)]; }
+
+    void copy_to_row_major(T *out) const {
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                out[x + y*w] = at(x, y);
+    }
+
+private:
+    int w, h;
+    std::vector<int> columns, rows;  // Storage offsets of each column and row
+    std::vector<T> samples;
+};
+
+// Calls fn(x, y) for every sample, in an order that walks the storage of Layout front to back
+// Passes written against this instead of nested x and y loops keep their reads local in any layout
+template <typename Fn>
+void for_each_sample(RowMajorLayout, int width, int height, Fn fn) {
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+            fn(x, y);
+}
+
+template <int Tile, typename Fn>
+void for_each_sample(TiledLayout<Tile>, int width, int height, Fn fn) {
+    for (int tileY = 0; tileY < height; tileY += Tile)
+        for (int tileX = 0; tileX < width; tileX += Tile)
+            for (int y = tileY; y < tileY + Tile && y < height; y++)
+                for (int x = tileX; x < tileX + Tile && x < width; x++)
+                    fn(x, y);
+}
+
+// Morton order visited as 8x8 blocks of row-major samples, which the Z-order curve keeps contiguous
+template <typename Fn>
+void for_each_sample(MortonLayout, int width, int height, Fn fn) {
+    int side = MortonLayout::padded_side(width, height);
+    for (int block = 0; block < side * side; block += 64) {
+        int blockX = 0, blockY = 0;
+        for (int bit = 0; (1 << (2*bit)) < side * side; bit++) {
+            blockX |= ((block >> (2*bit))     & 1) << bit;
+            blockY |= ((block >> (2*bit + 1)) & 1) << bit;
+        }
+        for (int y = blockY; y < blockY + 8 && y < height; y++)
+            for (int x = blockX; x < blockX + 8 && x < width; x++)
+                fn(x, y);
+    }
+}
+
+template <typename Layout, typename T, typename Fn>
+void for_each_sample(const Heightfield<Layout, T> &field, Fn fn) {
+    for_each_sample(Layout(), field.width(), field.height(), fn);
+}
+
+#endif
@@ -1,9 +1,14 @@
 #include <cmath>
+#include <map>
+#include <tuple>
 #include <string>
 #include <random>
 #include <iostream>
 #include <math.h>
 #include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+#include <mutex>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -16,6 +21,19 @@
 #include "shader.h"
 #include "camera.h"
 #include "perlin.h"
+#include "fbm.h"
+#include "fbm_multirate.h"
+#include "chunk_seams.h"
+#include "chunk_edges.h"
+#include "noise_context.h"
+#include "thread_pool.h"
+#include "terrain.h"
+#include "vertex_packing.h"
+#include "vertex_cache.h"
+#include "terrain_lod.h"
+#include "chunk_arena.h"
+#include "heap_counter.h"
+#include "clipmap.h"
 
 const GLint WIDTH = 1920, HEIGHT = 1080;
 
@@ -38,22 +56,130 @@ struct plant {
     }
 };
 
+struct terrainColor {
+    terrainColor(float _height, glm::vec3 _color) {
+        height = _height;
+        color = _color;
+        pack_color_unorm8(glm::value_ptr(color), packed);
+    };
+    float height;
+    glm::vec3 color;
+    uint8_t packed[4];  // Color as vertex bytes
+};
+
+// Interleaved terrain vertices, everything a chunk draws from lives in one buffer
+// Normals are packed as GL_INT_2_10_10_10_REV, colors as normalized bytes
+struct TerrainVertex {
+    float position[3];
+    uint32_t normal;
+    uint8_t color[4];
+};
+
+struct CompactTerrainVertex {
+    uint16_t height;   // Fraction of max_eased_height(), x and z come from gl_VertexID
+    uint16_t padding;  // Keeps the normal after it 4-byte aligned
+    uint32_t normal;
+    uint8_t color[4];
+};
+
+// Plant model vertex, the color is the material's diffuse color before MODEL_BRIGHTNESS
+struct ModelVertex {
+    float position[3];
+    uint32_t normal;
+    uint8_t color[4];
+};
+
+// Vertices and indices of a plant model, shared by the VAO of every chunk that draws it
+struct Model {
+    GLuint VBO;
+    GLuint EBO;
+    int indexCount;
+};
+
+// How terrain chunks are indexed
+enum IndexMode {
+    TRIANGLE_LIST,   // 6 indices per grid square
+    TRIANGLE_STRIPS  // One strip per row of squares, joined with primitive restart
+};
+
+// Index buffer shared by every terrain chunk and how to draw it
+struct TerrainIndexBuffer {
+    GLuint EBO;
+    GLenum mode;  // GL_TRIANGLES or GL_TRIANGLE_STRIP
+    GLenum type;  // GL_UNSIGNED_SHORT when every vertex of a chunk fits in 16 bits
+    int count;
+    
+    // With terrainLod, every level's interior in mode, then triangle lists of its border parts for every stitch mask
+    // of their own sides, indexed by those bits of the mask, see terrain_lod.h
+    int lodInteriorFirst[LOD_LEVELS];
+    int lodInteriorCount[LOD_LEVELS];
+    int lodInteriorTriangles[LOD_LEVELS];
+    int lodBorderFirst[LOD_LEVELS][LOD_BORDER_PARTS][LOD_STITCH_MASKS];
+    int lodBorderCount[LOD_LEVELS][LOD_BORDER_PARTS][LOD_STITCH_MASKS];
+};
+
+// How the terrain is drawn
+enum TerrainRenderer {
+    CHUNK_RENDERER,   // A mesh per chunk, see render()
+    CLIPMAP_RENDERER  // Nested grids centered on the camera, see clipmap.h and render_clipmap()
+};
+
+// Clipmap levels, their index buffer and the heights they draw from
+struct Clipmap {
+    GLuint VAO;      // No vertex buffers, the shader places vertices from gl_VertexID
+    GLuint EBO;
+    GLuint heights;  // GL_TEXTURE_2D_ARRAY of eased heights, one layer per level
+    GLenum type;
+    
+    // The full grid of the finest level, then rings for every hole position, see clipmap_first_hole()
+    int fullCount;
+    int ringFirst[CLIPMAP_HOLE_OFFSETS][CLIPMAP_HOLE_OFFSETS];
+    int ringCount[CLIPMAP_HOLE_OFFSETS][CLIPMAP_HOLE_OFFSETS];
+    
+    // Origin of every level, in samples of that level, valid once the heights have been generated
+    std::vector<int> originX;
+    std::vector<int> originY;
+    bool valid;
+};
+
 // Functions
 int init();
-void processInput(GLFWwindow *window, Shader &shader);
+void processInput(GLFWwindow *window, Shader &shader, Shader &clipmapShader);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, glm::mat4 &model, glm::mat4 &projection, int &nIndices, std::vector<GLuint> &tree_chunks, std::vector<GLuint> &flower_chunks);
+void setup_lighting(Shader &shader);
+void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, glm::mat4 &model, glm::mat4 &projection, const TerrainIndexBuffer &terrainIndices, std::vector<GLuint> &tree_chunks, std::vector<GLuint> &flower_chunks, int treeIndices, int flowerIndices, Clipmap &clipmap, Shader &clipmapShader, const NoiseContext &noise, ThreadPool &pool);
+Clipmap create_clipmap();
+void update_clipmap(Clipmap &clipmap, const NoiseContext &noise, ThreadPool &pool);
+int render_clipmap(const Clipmap &clipmap, Shader &shader);
 
 std::vector<int> generate_indices();
-std::vector<float> generate_noise_map(int xOffset, int yOffset);
-std::vector<float> generate_vertices(const std::vector<float> &noise_map);
-std::vector<float> generate_normals(const std::vector<int> &indices, const std::vector<float> &vertices);
-std::vector<float> generate_biome(const std::vector<float> &vertices, std::vector<plant> &plants, int xOffset, int yOffset);
-void generate_map_chunk(GLuint &VAO, int xOffset, int yOffset, std::vector<plant> &plants);
+std::vector<int> generate_strip_indices();
+TerrainIndexBuffer create_terrain_index_buffer(const std::vector<int> &indices);
+FbmDetail get_chunk_detail(int xOffset, int yOffset);
+FbmOctaves get_world_octaves();
+FbmOctaves get_chunk_octaves(int xOffset, int yOffset);
+ChunkSeamOctaves get_chunk_seam_octaves(int xOffset, int yOffset);
+ChunkEdgeCache create_chunk_edge_cache();
+bool use_analytic_normals();
+std::pmr::vector<float> generate_noise_map_derivatives(int xOffset, int yOffset, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache, std::pmr::vector<float> &noiseDx, std::pmr::vector<float> &noiseDy);
+std::pmr::vector<float> generate_noise_map_apron(int xOffset, int yOffset, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache, std::pmr::vector<float> &apronNoise);
+std::pmr::vector<float> generate_vertices(const std::pmr::vector<float> &noise_map);
+template <typename Vertex> void interleave_vertices(const std::pmr::vector<float> &vertices, const std::pmr::vector<uint32_t> &normals, const std::pmr::vector<uint8_t> &colors, Vertex *interleaved);
+std::pmr::vector<uint32_t> generate_analytic_normals(const std::pmr::vector<float> &noise_map, const std::pmr::vector<float> &noiseDx, const std::pmr::vector<float> &noiseDy);
+std::pmr::vector<uint32_t> generate_central_difference_normals(const std::pmr::vector<float> &apronNoise);
+std::pmr::vector<uint32_t> generate_area_weighted_normals(const std::pmr::vector<float> &apronNoise, ThreadPool &pool);
+const std::vector<terrainColor> &get_biome_colors();
+int get_biome(float height);
+const char *get_plant_type(const NoiseContext &noise, int x, int y, int xOffset, int yOffset);
+std::pmr::vector<uint8_t> generate_biome(const std::pmr::vector<float> &vertices, std::vector<plant> &plants, int xOffset, int yOffset, const NoiseContext &noise);
+template <typename Vertex> void build_map_chunk(Vertex *vertices, int xOffset, int yOffset, std::vector<plant> &plants, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache);
+template <typename Vertex> void build_chunk_vertices(std::vector<Vertex> &chunkVertices, int xOffset, int yOffset, std::vector<plant> &plants, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache);
+void generate_map_chunk(GLuint &VAO, const TerrainIndexBuffer &terrainIndices, int xOffset, int yOffset, std::vector<plant> &plants, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache);
 
-void load_model(GLuint &VAO, std::string filename);
-void setup_instancing(GLuint &VAO, std::vector<GLuint> &plant_chunk, std::string plant_type, std::vector<plant> &plants, std::string filename);
+Model load_model(std::string filename);
+void bind_model(GLuint &VAO, const Model &model);
+int setup_instancing(GLuint &VAO, std::vector<GLuint> &plant_chunk, std::string plant_type, std::vector<plant> &plants, std::string filename);
 
 GLFWwindow *window;
 
@@ -71,10 +197,65 @@ float originY = (chunkHeight * yMapChunks) / 2 - chunkHeight / 2;
 
 // Noise params
 int octaves = 5;
+const int FIXED_OCTAVES = 5;  // Octave count with a compile-time unrolled fBm loop, others take the runtime loop, see 'benchmark fbm'
 float meshHeight = 32;  // Vertical scaling
 float noiseScale = 64;  // Horizontal scaling
 float persistence = 0.5;
 float lacunarity = 2;
+uint64_t worldSeed = 0;  // 0 is the classic world
+int noiseThreads = std::thread::hardware_concurrency();  // Threads sharing the rows of a chunk
+NoisePrecision noisePrecision = SINGLE_PRECISION;  // See 'benchmark precision' for the height error
+NoiseBackend noiseBackend = PERLIN_BACKEND;
+NoiseEvaluation noiseEvaluation = LATTICE_CELLS;  // See 'benchmark cells'
+
+// Far chunk detail, see 'benchmark detail'
+// Samples near a chunk's sides keep as many octaves as the chunk across them, see 'benchmark seams'
+bool truncateFarOctaves = false;
+float farHeightQuantum = 0.5;  // World units of height chunks may drop per chunk of distance from the start
+int farOctaveBudget = 3;  // Octaves for chunks outside the render distance
+
+// Multi-rate fBm, low octaves sampled on a coarse grid and upsampled, see 'benchmark multirate'
+// Normals come from central differences while it's on, see use_analytic_normals()
+bool multiRateNoise = false;
+int multiRateStride = 4;
+float multiRateError = 0.25;  // World units of height the upsampled octaves may be off by
+
+// Analytic normals generate their own heights with the same noisePrecision and noiseEvaluation
+// Other backends and multi-rate noise fall back to central differences, which need one sample past every edge
+NormalMode normalMode = ANALYTIC_NORMALS;
+
+// Triangle strips need under half the indices of a list, see the index buffer size printed with printStats
+IndexMode indexMode = TRIANGLE_STRIPS;  // Levels of detail only draw their interiors this way, their borders are lists
+int cacheWindow = 6;  // Squares across each band of terrain triangles, fits a 16 entry vertex cache, see 'benchmark cache'
+
+// Geomipmapped chunks, drawn from every 2nd, 4th or 8th vertex further from the camera, see terrain_lod.h
+bool terrainLod = true;
+float lodDistance = 0.5;  // Chunk widths from the camera to a chunk before it drops a level, doubling for every level after
+
+// Geometry clipmap instead of chunk meshes, the same triangles every frame however far the view reaches
+// Plants still come from the chunks and are drawn with them
+TerrainRenderer terrainRenderer = CHUNK_RENDERER;
+int clipmapSize = 127;          // Vertices across every level, odd
+int clipmapLevels = 6;          // Each twice as wide as the one inside it
+float clipmapMorphWidth = 12;   // Vertices at the outer edge of a level that blend into the next level's heights
+
+// Terrain vertices store only a 16-bit height, the shader rebuilds x and z from gl_VertexID
+bool compactVertices = true;
+
+// Build chunks in one pass per row, noise to height to normal to color, straight into the vertex buffer
+// Multi-rate noise and area weighted normals need the whole chunk's noise first and keep the separate passes
+bool fusedChunkBuilder = true;
+
+// Chunks copy the samples they share with chunks built before them instead of evaluating them again, see 'benchmark edges'
+bool cacheChunkEdges = true;
+
+// Print the terrain build and upload measurements below, buffer sizes, and triangles drawn per frame
+bool printStats = false;
+
+// Time spent building terrain vertices, and creating and filling their buffers
+double terrainBuildTime = 0;
+size_t terrainBuildAllocations = 0;  // Through the global operator new, once the first row of chunks has warmed up every thread's arena
+double terrainUploadTime = 0;
 
 // Model params
 float MODEL_SCALE = 3;
@@ -101,48 +282,73 @@ int main() {
     glm::mat4 model;
     glm::mat4 projection;
     std::vector<plant> plants;
-
+    
     // Initialize GLFW and GLAD
     if (init() != 0)
         return -1;
     
     Shader objectShader("objectShader.vert", "objectShader.frag");
+    Shader clipmapShader("clipmap.vert", "objectShader.frag");
+    setup_lighting(clipmapShader);
+    setup_lighting(objectShader);
     
-    // Default to coloring to flat mode
-    objectShader.use();
-    objectShader.setBool("isFlat", true);
+    // Grid and height range of compact terrain vertices
+    objectShader.setInt("u_chunkWidth", chunkWidth);
+    objectShader.setFloat("u_maxHeight", max_eased_height(meshHeight));
     
-    // Lighting intensities and direction
-    objectShader.setVec3("light.ambient", 0.2, 0.2, 0.2);
-    objectShader.setVec3("light.diffuse", 0.3, 0.3, 0.3);
-    objectShader.setVec3("light.specular", 1.0, 1.0, 1.0);
-    objectShader.setVec3("light.direction", -0.2f, -1.0f, -0.3f);
+    // Permutation table shared by every chunk of this world
+    NoiseContext noise(worldSeed);
+    ThreadPool pool(noiseThreads);
+    
+    // Every chunk has the same grid, so all terrain VAOs share one index buffer
+    TerrainIndexBuffer terrainIndices = create_terrain_index_buffer(generate_indices());
+    ChunkEdgeCache edgeCache = create_chunk_edge_cache();
     
     std::vector<GLuint> map_chunks(xMapChunks * yMapChunks);
     
+    // Room for a plant on 1 in 200 vertices, more than Grass 1 ever gets, so placing them doesn't reallocate
+    plants.reserve(xMapChunks * yMapChunks * chunkWidth * chunkHeight / 200);
+    
     for (int y = 0; y < yMapChunks; y++)
         for (int x = 0; x < xMapChunks; x++) {
-            generate_map_chunk(map_chunks[x + y*xMapChunks], x, y, plants);
+            generate_map_chunk(map_chunks[x + y*xMapChunks], terrainIndices, x, y, plants, noise, pool, edgeCache);
         }
     
-    int nIndices = chunkWidth * chunkHeight * 6;
+    if (printStats) {
+        int vertexBytes = compactVertices ? sizeof(CompactTerrainVertex) : sizeof(TerrainVertex);
+        printf("Built %d terrain chunks in %f ms\n", xMapChunks * yMapChunks, 1000.0 * terrainBuildTime);
+        printf("Noise samples copied from neighbouring chunks: %ld\n", edgeCache.saved_samples());
+        printf("Heap allocations building terrain after the first row of chunks: %zu, %zu chunk arena blocks\n", terrainBuildAllocations, ChunkArena::heap_blocks());
+        printf("Uploaded %d terrain chunks in %f ms, %d bytes per vertex\n", xMapChunks * yMapChunks, 1000.0 * terrainUploadTime, vertexBytes);
+    }
     
     GLuint treeVAO, flowerVAO;
     std::vector<GLuint> tree_chunks(xMapChunks * yMapChunks);
     std::vector<GLuint> flower_chunks(xMapChunks * yMapChunks);
     
-    setup_instancing(treeVAO, tree_chunks, "tree", plants, "CommonTree_1.obj");
-    setup_instancing(flowerVAO, flower_chunks, "flower", plants, "Flowers.obj");
+    int treeIndices = setup_instancing(treeVAO, tree_chunks, "tree", plants, "CommonTree_1.obj");
+    int flowerIndices = setup_instancing(flowerVAO, flower_chunks, "flower", plants, "Flowers.obj");
+    
+    Clipmap clipmap = {};
+    if (terrainRenderer == CLIPMAP_RENDERER)
+        clipmap = create_clipmap();
+    
+    // The clipmap reaches half the outermost level across from the camera
+    float viewDistance = (float)chunkWidth * (chunk_render_distance - 1.2f);
+    if (terrainRenderer == CLIPMAP_RENDERER)
+        viewDistance = (float)(1 << (clipmapLevels - 1)) * (clipmapSize - 1) / 2;
     
     while (!glfwWindowShouldClose(window)) {
-        objectShader.use();
-        projection = glm::perspective(glm::radians(camera.Zoom), (float)WIDTH / (float)HEIGHT, 0.1f, (float)chunkWidth * (chunk_render_distance - 1.2f));
+        projection = glm::perspective(glm::radians(camera.Zoom), (float)WIDTH / (float)HEIGHT, 0.1f, viewDistance);
         view = camera.GetViewMatrix();
-        objectShader.setMat4("u_projection", projection);
-        objectShader.setMat4("u_view", view);
-        objectShader.setVec3("u_viewPos", camera.Position);
+        for (Shader *shader : { &clipmapShader, &objectShader }) {
+            shader->use();
+            shader->setMat4("u_projection", projection);
+            shader->setMat4("u_view", view);
+            shader->setVec3("u_viewPos", camera.Position);
+        }
         
-        render(map_chunks, objectShader, view, model, projection, nIndices, tree_chunks, flower_chunks);
+        render(map_chunks, objectShader, view, model, projection, terrainIndices, tree_chunks, flower_chunks, treeIndices, flowerIndices, clipmap, clipmapShader, noise, pool);
     }
     
     for (int i = 0; i < map_chunks.size(); i++) {
@@ -151,16 +357,23 @@ int main() {
         glDeleteVertexArrays(1, &flower_chunks[i]);
     }
     
-    // TODO VBOs and EBOs aren't being deleted
-    // glDeleteBuffers(3, VBO);
-    // glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &terrainIndices.EBO);
+    if (terrainRenderer == CLIPMAP_RENDERER) {
+        glDeleteVertexArrays(1, &clipmap.VAO);
+        glDeleteBuffers(1, &clipmap.EBO);
+        glDeleteTextures(1, &clipmap.heights);
+    }
+    
+    // TODO VBOs aren't being deleted
+    // glDeleteBuffers(1, &VBO);
     
     glfwTerminate();
     
     return 0;
 }
 
-void setup_instancing(GLuint &VAO, std::vector<GLuint> &plant_chunk, std::string plant_type, std::vector<plant> &plants, std::string filename) {
+// Returns the number of indices in the plant's model
+int setup_instancing(GLuint &VAO, std::vector<GLuint> &plant_chunk, std::string plant_type, std::vector<plant> &plants, std::string filename) {
     std::vector<std::vector<float>> chunkInstances;
     chunkInstances.resize(xMapChunks * yMapChunks);
     
@@ -180,13 +393,14 @@ void setup_instancing(GLuint &VAO, std::vector<GLuint> &plant_chunk, std::string
     
     GLuint instancesVBO[xMapChunks * yMapChunks];
     glGenBuffers(xMapChunks * yMapChunks, instancesVBO);
+    Model model = load_model(filename);
     
     for (int y = 0; y < yMapChunks; y++) {
         for (int x = 0; x < xMapChunks; x++) {
             int pos = x + y*xMapChunks;
-            load_model(plant_chunk[pos], filename);
+            bind_model(plant_chunk[pos], model);
             
-            glBindVertexArray(plant_chunk[pos]);
+            // Only the instance positions are per chunk
             glBindBuffer(GL_ARRAY_BUFFER, instancesVBO[pos]);
             glBufferData(GL_ARRAY_BUFFER, sizeof(float) * chunkInstances[pos].size(), &chunkInstances[pos][0], GL_STATIC_DRAW);
             
@@ -198,15 +412,30 @@ void setup_instancing(GLuint &VAO, std::vector<GLuint> &plant_chunk, std::string
             glVertexAttribDivisor(3, 1);
         }
     }
+    
+    return model.indexCount;
 }
 
-void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, glm::mat4 &model, glm::mat4 &projection, int &nIndices, std::vector<GLuint> &tree_chunks, std::vector<GLuint> &flower_chunks) {
+// Lighting shared by the terrain and plant shaders
+void setup_lighting(Shader &shader) {
+    // Default to coloring to flat mode
+    shader.use();
+    shader.setBool("isFlat", true);
+    
+    // Lighting intensities and direction
+    shader.setVec3("light.ambient", 0.2, 0.2, 0.2);
+    shader.setVec3("light.diffuse", 0.3, 0.3, 0.3);
+    shader.setVec3("light.specular", 1.0, 1.0, 1.0);
+    shader.setVec3("light.direction", -0.2f, -1.0f, -0.3f);
+}
+
+void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, glm::mat4 &model, glm::mat4 &projection, const TerrainIndexBuffer &terrainIndices, std::vector<GLuint> &tree_chunks, std::vector<GLuint> &flower_chunks, int treeIndices, int flowerIndices, Clipmap &clipmap, Shader &clipmapShader, const NoiseContext &noise, ThreadPool &pool) {
     // Per-frame time logic
     currentFrame = glfwGetTime();
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
     
-    processInput(window, shader);
+    processInput(window, shader, clipmapShader);
     
     glClearColor(0.53, 0.81, 0.92, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -215,6 +444,27 @@ void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, gl
     gridPosX = (int)(camera.Position.x - originX) / chunkWidth + xMapChunks / 2;
     gridPosY = (int)(camera.Position.z - originY) / chunkHeight + yMapChunks / 2;
     
+    // Level of detail of every chunk from the camera's distance to it, neighbours kept at most one level apart
+    static std::vector<int> chunkLods(xMapChunks * yMapChunks, 0);
+    if (terrainLod && terrainRenderer == CHUNK_RENDERER) {
+        for (int y = 0; y < yMapChunks; y++)
+            for (int x = 0; x < xMapChunks; x++) {
+                float minX = -chunkWidth / 2.0 + (chunkWidth - 1) * x, minZ = -chunkHeight / 2.0 + (chunkHeight - 1) * y;
+                float dx = std::fmax(std::fmax(minX - camera.Position.x, camera.Position.x - minX - (chunkWidth - 1)), 0.0f);
+                float dz = std::fmax(std::fmax(minZ - camera.Position.z, camera.Position.z - minZ - (chunkHeight - 1)), 0.0f);
+                chunkLods[x + y*xMapChunks] = select_lod_level(std::sqrt(dx*dx + dz*dz), lodDistance * (chunkWidth - 1));
+            }
+        limit_lod_steps(chunkLods, xMapChunks, yMapChunks);
+    }
+    int terrainTriangles = 0;
+    
+    // Clipmap terrain, chunks below only draw their plants
+    if (terrainRenderer == CLIPMAP_RENDERER) {
+        update_clipmap(clipmap, noise, pool);
+        terrainTriangles = render_clipmap(clipmap, clipmapShader);
+        shader.use();
+    }
+    
     // Render map chunks
     for (int y = 0; y < yMapChunks; y++)
         for (int x = 0; x < xMapChunks; x++) {
@@ -223,23 +473,46 @@ void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, gl
                 model = glm::mat4(1.0f);
                 model = glm::translate(model, glm::vec3(-chunkWidth / 2.0 + (chunkWidth - 1) * x, 0.0, -chunkHeight / 2.0 + (chunkHeight - 1) * y));
                 shader.setMat4("u_model", model);
+                shader.setBool("u_compactTerrain", compactVertices);
+                shader.setFloat("u_colorScale", 1);
                 
-                // Terrain chunk
+                // Terrain chunk, stitched to the sides of any coarser neighbours, unless the clipmap drew the terrain
                 glBindVertexArray(map_chunks[x + y*xMapChunks]);
-                glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_INT, 0);
+                if (terrainRenderer == CHUNK_RENDERER && terrainLod) {
+                    int level = chunkLods[x + y*xMapChunks], mask = lod_stitch_mask(chunkLods, x, y, xMapChunks, yMapChunks);
+                    int indexBytes = terrainIndices.type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+                    glDrawElements(terrainIndices.mode, terrainIndices.lodInteriorCount[level], terrainIndices.type, (void*)(intptr_t)(terrainIndices.lodInteriorFirst[level] * indexBytes));
+                    terrainTriangles += terrainIndices.lodInteriorTriangles[level];
+                    
+                    // Every border part as stitched for the sides it touches, in one call
+                    GLsizei borderCounts[LOD_BORDER_PARTS];
+                    const void *borderOffsets[LOD_BORDER_PARTS];
+                    for (int part = 0; part < LOD_BORDER_PARTS; part++) {
+                        int partMask = mask & LOD_BORDER_SIDES[part];
+                        borderCounts[part] = terrainIndices.lodBorderCount[level][part][partMask];
+                        borderOffsets[part] = (void*)(intptr_t)(terrainIndices.lodBorderFirst[level][part][partMask] * indexBytes);
+                        terrainTriangles += borderCounts[part] / 3;
+                    }
+                    glMultiDrawElements(GL_TRIANGLES, borderCounts, terrainIndices.type, borderOffsets, LOD_BORDER_PARTS);
+                } else if (terrainRenderer == CHUNK_RENDERER) {
+                    glDrawElements(terrainIndices.mode, terrainIndices.count, terrainIndices.type, 0);
+                    terrainTriangles += (chunkWidth - 1) * (chunkHeight - 1) * 2;
+                }
                 
                 // Plant chunks
                 model = glm::mat4(1.0f);
                 model = glm::translate(model, glm::vec3(-chunkWidth / 2.0 + (chunkWidth - 1) * x, 0.0, -chunkHeight / 2.0 + (chunkHeight - 1) * y));
                 model = glm::scale(model, glm::vec3(MODEL_SCALE));
                 shader.setMat4("u_model", model);
-
+                shader.setBool("u_compactTerrain", false);
+                shader.setFloat("u_colorScale", MODEL_BRIGHTNESS);
+    
                 glEnable(GL_CULL_FACE);
                 glBindVertexArray(flower_chunks[x + y*xMapChunks]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 1300, 16);
-
+                glDrawElementsInstanced(GL_TRIANGLES, flowerIndices, GL_UNSIGNED_INT, 0, 16);
+    
                 glBindVertexArray(tree_chunks[x + y*xMapChunks]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 10192, 8);
+                glDrawElementsInstanced(GL_TRIANGLES, treeIndices, GL_UNSIGNED_INT, 0, 8);
                 glDisable(GL_CULL_FACE);
             }
         }
@@ -249,7 +522,10 @@ void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, gl
     nbFrames++;
     // If last prinf() was more than 1 sec ago printf and reset timer
     if (currentTime - lastTime >= 1.0 ){
-        printf("%f ms/frame\n", 1000.0/double(nbFrames));
+        if (printStats)
+            printf("%f ms/frame, %d terrain triangles\n", 1000.0/double(nbFrames), terrainTriangles);
+        else
+            printf("%f ms/frame\n", 1000.0/double(nbFrames));
         nbFrames = 0;
         lastTime += 1.0;
     }
@@ -260,19 +536,23 @@ void render(std::vector<GLuint> &map_chunks, Shader &shader, glm::mat4 &view, gl
     glfwSwapBuffers(window);
 }
 
-void load_model(GLuint &VAO, std::string filename) {
-    std::vector<float> vertices;
+// Loads a model and uploads its vertices and cache ordered indices, once for every chunk
+Model load_model(std::string filename) {
+    std::vector<ModelVertex> vertices;
     std::vector<int> indices;
     
+    // Corners with the same position, normal and material share a vertex
+    std::map<std::tuple<int, int, int>, int> vertexIds;
+    
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
-
+    
     std::string warn;
     std::string err;
-
+    
     tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str());
-
+    
     if (!warn.empty()) {
         std::cout << warn << std::endl;
     } else if (!err.empty()) {
@@ -284,273 +564,719 @@ void load_model(GLuint &VAO, std::string filename) {
         size_t index_offset = 0;
         for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
             int fv = shapes[s].mesh.num_face_vertices[f];
-
+    
             // Loop over vertices in the face.
             for (size_t v = 0; v < fv; v++) {
                 tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                vertices.push_back(attrib.vertices[3*idx.vertex_index+0]);
-                vertices.push_back(attrib.vertices[3*idx.vertex_index+1]);
-                vertices.push_back(attrib.vertices[3*idx.vertex_index+2]);
-                vertices.push_back(attrib.normals[3*idx.normal_index+0]);
-                vertices.push_back(attrib.normals[3*idx.normal_index+1]);
-                vertices.push_back(attrib.normals[3*idx.normal_index+2]);
-                vertices.push_back(materials[shapes[s].mesh.material_ids[f]].diffuse[0] * MODEL_BRIGHTNESS);
-                vertices.push_back(materials[shapes[s].mesh.material_ids[f]].diffuse[1] * MODEL_BRIGHTNESS);
-                vertices.push_back(materials[shapes[s].mesh.material_ids[f]].diffuse[2] * MODEL_BRIGHTNESS);
+                int material = shapes[s].mesh.material_ids[f];
+                auto found = vertexIds.emplace(std::make_tuple(idx.vertex_index, idx.normal_index, material), (int)vertices.size());
+                indices.push_back(found.first->second);
+                if (!found.second)
+                    continue;
+                
+                ModelVertex vertex;
+                vertex.position[0] = attrib.vertices[3*idx.vertex_index+0];
+                vertex.position[1] = attrib.vertices[3*idx.vertex_index+1];
+                vertex.position[2] = attrib.vertices[3*idx.vertex_index+2];
+                vertex.normal = pack_normal_2_10_10_10(&attrib.normals[3*idx.normal_index]);
+                // MODEL_BRIGHTNESS is applied in the shader, the brightened colors don't fit in a byte
+                pack_color_unorm8(materials[material].diffuse, vertex.color);
+                vertices.push_back(vertex);
             }
             index_offset += fv;
         }
     }
     
-    GLuint VBO, EBO;
+    // Reorder the triangles for the post-transform vertex cache
+    indices = optimize_vertex_cache(indices, vertices.size());
     
-    // Create buffers and arrays
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    glGenVertexArrays(1, &VAO);
+    Model model;
+    model.indexCount = indices.size();
+    
+    // Create buffers, the indices go through GL_ARRAY_BUFFER since element array bindings belong to a VAO
+    glGenBuffers(1, &model.VBO);
+    glGenBuffers(1, &model.EBO);
+    glBindBuffer(GL_ARRAY_BUFFER, model.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ModelVertex), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, model.EBO);
+    glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
     
-    // Bind vertices to VBO
+    return model;
+}
+
+// Creates a VAO drawing from a model's shared buffers
+void bind_model(GLuint &VAO, const Model &model) {
+    glGenVertexArrays(1, &VAO);
     glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, model.VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.EBO);
     
     // Configure vertex position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, position));
     glEnableVertexAttribArray(0);
     
     // Configure vertex normals attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, normal));
     glEnableVertexAttribArray(1);
     
     // Configure vertex color attribute
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 9 * sizeof(float), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ModelVertex), (void*)offsetof(ModelVertex, color));
     glEnableVertexAttribArray(2);
 }
 
-void generate_map_chunk(GLuint &VAO, int xOffset, int yOffset, std::vector<plant> &plants) {
-    std::vector<int> indices;
-    std::vector<float> noise_map;
-    std::vector<float> vertices;
-    std::vector<float> normals;
-    std::vector<float> colors;
+// Fills the bound VBO with interleaved vertices and points the normal and color attributes at them
+template <typename Vertex>
+void upload_terrain_vertices(const std::vector<Vertex> &vertices) {
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
     
-    // Generate map
-    indices = generate_indices();
-    noise_map = generate_noise_map(xOffset, yOffset);
-    vertices = generate_vertices(noise_map);
-    normals = generate_normals(indices, vertices);
-    colors = generate_biome(vertices, plants, xOffset, yOffset);
+    // Configure vertex normals attribute
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
     
-    GLuint VBO[3], EBO;
+    // Configure vertex colors attribute
+    glVertexAttribPointer(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+    glEnableVertexAttribArray(2);
+}
+
+void generate_map_chunk(GLuint &VAO, const TerrainIndexBuffer &terrainIndices, int xOffset, int yOffset, std::vector<plant> &plants, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache) {
+    // Kept from the last chunk, glBufferData copies the vertices out
+    static std::vector<TerrainVertex> chunkVertices;
+    static std::vector<CompactTerrainVertex> compactChunkVertices;
+    
+    size_t allocationsBefore = heap_allocations();
+    double buildStart = glfwGetTime();
+    if (compactVertices)
+        build_chunk_vertices(compactChunkVertices, xOffset, yOffset, plants, noise, pool, edgeCache);
+    else
+        build_chunk_vertices(chunkVertices, xOffset, yOffset, plants, noise, pool, edgeCache);
+    terrainBuildTime += glfwGetTime() - buildStart;
+    if (yOffset > 0)
+        terrainBuildAllocations += heap_allocations() - allocationsBefore;
+    
+    double uploadStart = glfwGetTime();
+    GLuint VBO;
     
     // Create buffers and arrays
-    glGenBuffers(3, VBO);
-    glGenBuffers(1, &EBO);
+    glGenBuffers(1, &VBO);
     glGenVertexArrays(1, &VAO);
     
-    // Bind vertices to VBO
+    // Bind interleaved vertices to VBO
     glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if (compactVertices) {
+        upload_terrain_vertices(compactChunkVertices);
     
-    // Create element buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
+        // Configure vertex height attribute, read as aPos.x
+        glVertexAttribPointer(0, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactTerrainVertex), (void*)offsetof(CompactTerrainVertex, height));
+    } else {
+        upload_terrain_vertices(chunkVertices);
     
-    // Configure vertex position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        // Configure vertex position attribute
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, position));
+    }
     glEnableVertexAttribArray(0);
     
-    // Bind vertices to VBO
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), &normals[0], GL_STATIC_DRAW);
-    
-    // Configure vertex normals attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
+    // Shared element buffer
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainIndices.EBO);
+    terrainUploadTime += glfwGetTime() - uploadStart;
+}
+
+// One chunk of vertices in chunkVertices, in a single fused pass when the settings allow it
+template <typename Vertex>
+void build_chunk_vertices(std::vector<Vertex> &chunkVertices, int xOffset, int yOffset, std::vector<plant> &plants, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache) {
+    chunkVertices.resize(chunkWidth * chunkHeight);
+    if (fusedChunkBuilder && !multiRateNoise && normalMode != AREA_WEIGHTED_NORMALS) {
+        build_map_chunk(chunkVertices.data(), xOffset, yOffset, plants, noise, pool, edgeCache);
+        return;
+    }
     
-    // Bind vertices to VBO
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[2]);
-    glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(float), &colors[0], GL_STATIC_DRAW);
+    // Every pass allocates from this thread's arena, it's all freed at once when the chunk is done
+    ArenaScope scratch;
+    std::pmr::vector<float> noise_map(scratch.resource());
+    std::pmr::vector<float> vertices(scratch.resource());
+    std::pmr::vector<uint32_t> normals(scratch.resource());
+    std::pmr::vector<uint8_t> colors(scratch.resource());
     
-    // Configure vertex colors attribute
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(2);
+    // Generate map
+    if (use_analytic_normals()) {
+        // Normals come straight from the noise derivatives, no pass over the triangles
+        std::pmr::vector<float> noiseDx(scratch.resource()), noiseDy(scratch.resource());
+        noise_map = generate_noise_map_derivatives(xOffset, yOffset, noise, pool, edgeCache, noiseDx, noiseDy);
+        vertices = generate_vertices(noise_map);
+        normals = generate_analytic_normals(noise_map, noiseDx, noiseDy);
+    } else {
+        std::pmr::vector<float> apronNoise(scratch.resource());
+        noise_map = generate_noise_map_apron(xOffset, yOffset, noise, pool, edgeCache, apronNoise);
+        vertices = generate_vertices(noise_map);
+        if (normalMode == AREA_WEIGHTED_NORMALS)
+            normals = generate_area_weighted_normals(apronNoise, pool);
+        else
+            normals = generate_central_difference_normals(apronNoise);
+    }
+    colors = generate_biome(vertices, plants, xOffset, yOffset, noise);
+    interleave_vertices(vertices, normals, colors, chunkVertices.data());
 }
 
 glm::vec3 get_color(int r, int g, int b) {
     return glm::vec3(r/255.0, g/255.0, b/255.0);
 }
 
-std::vector<float> generate_noise_map(int offsetX, int offsetY) {
-    std::vector<float> noiseValues;
-    std::vector<float> normalizedNoiseValues;
-    std::vector<int> p = get_permutation_vector();
-    
-    float amp  = 1;
-    float freq = 1;
-    float maxPossibleHeight = 0;
+// Chunks further from the starting chunk get a coarser height quantum,
+// and chunks the camera starts out of render distance of also get an octave budget
+FbmDetail get_chunk_detail(int xOffset, int yOffset) {
+    int distance = std::max(std::abs(xOffset - xMapChunks / 2), std::abs(yOffset - yMapChunks / 2));
     
-    for (int i = 0; i < octaves; i++) {
-        maxPossibleHeight += amp;
-        amp *= persistence;
-    }
-    
-    for (int y = 0; y < chunkHeight; y++) {
-        for (int x = 0; x < chunkWidth; x++) {
-            amp  = 1;
-            freq = 1;
-            float noiseHeight = 0;
-            for (int i = 0; i < octaves; i++) {
-                float xSample = (x + offsetX * (chunkWidth-1))  / noiseScale * freq;
-                float ySample = (y + offsetY * (chunkHeight-1)) / noiseScale * freq;
-                
-                float perlinValue = perlin_noise(xSample, ySample, p);
-                noiseHeight += perlinValue * amp;
-                
-                // Lacunarity  --> Increase in frequency of octaves
-                // Persistence --> Decrease in amplitude of octaves
-                amp  *= persistence;
-                freq *= lacunarity;
-            }
-            
-            noiseValues.push_back(noiseHeight);
-        }
-    }
+    // Measured where the ease curve is at its usual peak, normalized noise of 1
+    float worldQuantum = farHeightQuantum * distance;
+    float heightQuantum = worldQuantum / ease_height_slope(1, meshHeight);
     
-    for (int y = 0; y < chunkHeight; y++) {
-        for (int x = 0; x < chunkWidth; x++) {
-            // Inverse lerp and scale values to range from 0 to 1
-            normalizedNoiseValues.push_back((noiseValues[x + y*chunkWidth] + 1) / maxPossibleHeight);
-        }
-    }
+    return FbmDetail{ distance > chunk_render_distance ? farOctaveBudget : 0, heightQuantum };
+}
 
-    return normalizedNoiseValues;
+// Every octave of the noise settings, a chunk keeps all of them or the first few
+FbmOctaves get_world_octaves() {
+    return get_fbm_octaves(FbmParams{ octaves, noiseScale, persistence, lacunarity, noisePrecision, noiseBackend, noiseEvaluation });
 }
 
-struct terrainColor {
-    terrainColor(float _height, glm::vec3 _color) {
-        height = _height;
-        color = _color;
+FbmOctaves get_chunk_octaves(int offsetX, int offsetY) {
+    FbmOctaves fbm = get_world_octaves();
+    if (truncateFarOctaves)
+        fbm = truncate_fbm_octaves(fbm, get_chunk_detail(offsetX, offsetY));
+    return fbm;
+}
+
+// Octaves of every band of a chunk's samples, samples near a side keep as many octaves as the chunk across it
+// so truncated chunks still meet their neighbours without cracks, see chunk_seams.h
+ChunkSeamOctaves get_chunk_seam_octaves(int offsetX, int offsetY) {
+    return get_seam_octaves(offsetX, offsetY, get_chunk_octaves);
+}
+
+// Chunks built from the derivatives keep heights and derivatives of their border samples,
+// the others keep heights with the one sample of apron central differences read
+ChunkEdgeCache create_chunk_edge_cache() {
+    // An empty grid caches nothing
+    int chunksX = cacheChunkEdges ? xMapChunks : 0, chunksY = cacheChunkEdges ? yMapChunks : 0;
+    if (use_analytic_normals())
+        return ChunkEdgeCache(chunksX, chunksY, chunkWidth, chunkHeight, 0, 3);
+    return ChunkEdgeCache(chunksX, chunksY, chunkWidth, chunkHeight, 1, 1);
+}
+
+// Analytic normals need Perlin derivatives of every octave at every vertex, so multi-rate noise can't use them
+bool use_analytic_normals() {
+    return normalMode == ANALYTIC_NORMALS && noiseBackend == PERLIN_BACKEND && !multiRateNoise;
+}
+
+// Biome colors by height, built once
+// NOTE: Terrain color height is a value between 0 and 1
+const std::vector<terrainColor> &get_biome_colors() {
+    static const std::vector<terrainColor> biomeColors = {
+        terrainColor(WATER_HEIGHT * 0.5, get_color(60,  95, 190)),  // Deep water
+        terrainColor(WATER_HEIGHT,        get_color(60, 100, 190)), // Shallow water
+        terrainColor(0.15, get_color(210, 215, 130)),               // Sand
+        terrainColor(0.30, get_color( 95, 165,  30)),               // Grass 1
+        terrainColor(0.40, get_color( 65, 115,  20)),               // Grass 2
+        terrainColor(0.50, get_color( 90,  65,  60)),               // Rock 1
+        terrainColor(0.80, get_color( 75,  60,  55)),               // Rock 2
+        terrainColor(1.00, get_color(255, 255, 255))                // Snow
     };
-    float height;
-    glm::vec3 color;
-};
+    return biomeColors;
+}
 
-std::vector<float> generate_biome(const std::vector<float> &vertices, std::vector<plant> &plants, int xOffset, int yOffset) {
-    std::vector<float> colors;
-    std::vector<terrainColor> biomeColors;
-    glm::vec3 color = get_color(255, 255, 255);
-    
-    // NOTE: Terrain color height is a value between 0 and 1
-    biomeColors.push_back(terrainColor(WATER_HEIGHT * 0.5, get_color(60,  95, 190)));   // Deep water
-    biomeColors.push_back(terrainColor(WATER_HEIGHT,        get_color(60, 100, 190)));  // Shallow water
-    biomeColors.push_back(terrainColor(0.15, get_color(210, 215, 130)));                // Sand
-    biomeColors.push_back(terrainColor(0.30, get_color( 95, 165,  30)));                // Grass 1
-    biomeColors.push_back(terrainColor(0.40, get_color( 65, 115,  20)));                // Grass 2
-    biomeColors.push_back(terrainColor(0.50, get_color( 90,  65,  60)));                // Rock 1
-    biomeColors.push_back(terrainColor(0.80, get_color( 75,  60,  55)));                // Rock 2
-    biomeColors.push_back(terrainColor(1.00, get_color(255, 255, 255)));                // Snow
-    
-    std::string plantType;
+// Index in get_biome_colors() of the lowest biome reaching a vertex's y-coord, anything above meshHeight is snow
+int get_biome(float height) {
+    const std::vector<terrainColor> &biomeColors = get_biome_colors();
+    for (int j = 0; j < biomeColors.size() - 1; j++) {
+        // NOTE: The max height of a vertex is "meshHeight"
+        if (height <= biomeColors[j].height * meshHeight)
+            return j;
+    }
+    return biomeColors.size() - 1;
+}
+
+// Plants grow on 0.5% of the Grass 1 vertices, 70% of them flowers, NULL for the rest
+// Picked by hashing the vertex and its chunk instead of rand(), so any thread can place them and a seed always gets the same ones
+const char *get_plant_type(const NoiseContext &noise, int x, int y, int xOffset, int yOffset) {
+    uint64_t hash = noise.hash(x + xOffset * chunkWidth, y + yOffset * chunkHeight);
+    if (hash % 1000 >= 5)
+        return nullptr;
+    return (hash / 1000) % 100 < 70 ? "flower" : "tree";
+}
+
+std::pmr::vector<uint8_t> generate_biome(const std::pmr::vector<float> &vertices, std::vector<plant> &plants, int xOffset, int yOffset, const NoiseContext &noise) {
+    std::pmr::vector<uint8_t> colors(vertices.size() / 3 * 4, &chunk_arena());
+    const std::vector<terrainColor> &biomeColors = get_biome_colors();
     
     // Determine which color to assign each vertex by its y-coord
     // Iterate through vertex y values
     for (int i = 1; i < vertices.size(); i += 3) {
-        for (int j = 0; j < biomeColors.size(); j++) {
-            // NOTE: The max height of a vertex is "meshHeight"
-            if (vertices[i] <= biomeColors[j].height * meshHeight) {
-                color = biomeColors[j].color;
-                if (j == 3) {
-                    if (rand() % 1000 < 5) {
-                        if (rand() % 100 < 70) {
-                            plantType = "flower";
-                        } else {
-                            plantType = "tree";
-                        }
-                        plants.push_back(plant{plantType, vertices[i-1], vertices[i], vertices[i+1], xOffset, yOffset});
-                    }
-                }
-                break;
-            }
+        int biome = get_biome(vertices[i]);
+        std::copy(biomeColors[biome].packed, biomeColors[biome].packed + 4, &colors[(i / 3) * 4]);
+    
+        if (biome == 3) {
+            const char *plantType = get_plant_type(noise, vertices[i-1], vertices[i+1], xOffset, yOffset);
+            if (plantType)
+                plants.push_back(plant{plantType, vertices[i-1], vertices[i], vertices[i+1], xOffset, yOffset});
         }
-        colors.push_back(color.r);
-        colors.push_back(color.g);
-        colors.push_back(color.b);
     }
     return colors;
 }
 
-std::vector<float> generate_normals(const std::vector<int> &indices, const std::vector<float> &vertices) {
-    int pos;
-    glm::vec3 normal;
-    std::vector<float> normals;
-    std::vector<glm::vec3> verts;
+// One normal per vertex from the noise derivatives
+std::pmr::vector<uint32_t> generate_analytic_normals(const std::pmr::vector<float> &noise_map, const std::pmr::vector<float> &noiseDx, const std::pmr::vector<float> &noiseDy) {
+    std::pmr::vector<uint32_t> normals(noise_map.size(), &chunk_arena());
+    float normal[3];
+    
+    for (int i = 0; i < noise_map.size(); i++) {
+        eased_normal(noise_map[i], noiseDx[i], noiseDy[i], meshHeight, WATER_HEIGHT, normal);
+        normals[i] = pack_normal_2_10_10_10(normal);
+    }
     
-    // Get the vertices of each triangle in mesh
-    // For each group of indices
-    for (int i = 0; i < indices.size(); i += 3) {
-        
-        // Get the vertices (point) for each index
-        for (int j = 0; j < 3; j++) {
-            pos = indices[i+j]*3;
-            verts.push_back(glm::vec3(vertices[pos], vertices[pos+1], vertices[pos+2]));
+    return normals;
+}
+
+// One normal per vertex from the heights around it, in a single pass over the noise
+std::pmr::vector<uint32_t> generate_central_difference_normals(const std::pmr::vector<float> &apronNoise) {
+    std::pmr::vector<uint32_t> normals(chunkWidth * chunkHeight, &chunk_arena());
+    
+    central_difference_normals(apronNoise.data(), chunkWidth, chunkHeight, meshHeight, WATER_HEIGHT, [&](int y, const float *nx, const float *ny, const float *nz) {
+        for (int x = 0; x < chunkWidth; x++) {
+            float normal[3] = { nx[x], ny[x], nz[x] };
+            normals[x + y*chunkWidth] = pack_normal_2_10_10_10(normal);
         }
-        
-        // Get vectors of two edges of triangle
-        glm::vec3 U = verts[i+1] - verts[i];
-        glm::vec3 V = verts[i+2] - verts[i];
-        
-        // Calculate normal
-        normal = glm::normalize(-glm::cross(U, V));
-        normals.push_back(normal.x);
-        normals.push_back(normal.y);
-        normals.push_back(normal.z);
-    }
+    });
+    
+    return normals;
+}
+
+// Smooth normals from the triangles around each vertex, split across the pool by rows
+std::pmr::vector<uint32_t> generate_area_weighted_normals(const std::pmr::vector<float> &apronNoise, ThreadPool &pool) {
+    std::pmr::vector<uint32_t> normals(chunkWidth * chunkHeight, &chunk_arena());
+    
+    area_weighted_normals(pool, apronNoise.data(), chunkWidth, chunkHeight, meshHeight, WATER_HEIGHT, [&](int y, const float *nx, const float *ny, const float *nz) {
+        for (int x = 0; x < chunkWidth; x++) {
+            float normal[3] = { nx[x], ny[x], nz[x] };
+            normals[x + y*chunkWidth] = pack_normal_2_10_10_10(normal);
+        }
+    });
     
     return normals;
 }
 
-std::vector<float> generate_vertices(const std::vector<float> &noise_map) {
-    std::vector<float> v;
+// Heights plus their derivatives per world unit, for analytic normals
+std::pmr::vector<float> generate_noise_map_derivatives(int offsetX, int offsetY, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache,
+                                                       std::pmr::vector<float> &noiseDx, std::pmr::vector<float> &noiseDy) {
+    std::pmr::vector<float> noiseValues(chunkWidth * chunkHeight, &chunk_arena());
+    noiseDx.resize(chunkWidth * chunkHeight);
+    noiseDy.resize(chunkWidth * chunkHeight);
+    ChunkSeamOctaves seams = get_chunk_seam_octaves(offsetX, offsetY);
+    
+    // Samples shared with chunks built before this one are copied, the rest are generated
+    float *blocks[3] = { noiseValues.data(), noiseDx.data(), noiseDy.data() };
+    edgeCache.fetch_block(offsetX, offsetY, blocks, chunkWidth);
+    ChunkRect rect = edgeCache.uncached(offsetX, offsetY);
+    
+    int originX = offsetX * (chunkWidth-1);
+    int originY = offsetY * (chunkHeight-1);
+    for_each_seam_block(seams, chunkWidth, chunkHeight, rect.firstX, rect.lastX, rect.firstY, rect.lastY, [&](const FbmOctaves &fbm, int firstX, int lastX, int firstY, int lastY) {
+        pool.parallel_for(lastY - firstY, [&](int firstRow, int lastRow) {
+            generate_fbm_derivative_block<FIXED_OCTAVES>(noiseValues.data(), noiseDx.data(), noiseDy.data(), chunkWidth, firstX, lastX,
+                                                         firstY + firstRow, firstY + lastRow, originX, originY, fbm, noise);
+        });
+    });
+    edgeCache.store_block(offsetX, offsetY, blocks, chunkWidth);
+    edgeCache.finish(offsetX, offsetY);
+    
+    return noiseValues;
+}
+
+// Heights for every chunk with one sample of apron around it, returns the chunk's own heights
+std::pmr::vector<float> generate_noise_map_apron(int offsetX, int offsetY, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache,
+                                                 std::pmr::vector<float> &apronNoise) {
+    int apronWidth = chunkWidth + 2, apronHeight = chunkHeight + 2;
+    apronNoise.resize(apronWidth * apronHeight);
+    ChunkSeamOctaves seams = get_chunk_seam_octaves(offsetX, offsetY);
+    
+    float *blocks[1] = { apronNoise.data() };
+    edgeCache.fetch_block(offsetX, offsetY, blocks, apronWidth);
+    ChunkRect rect = edgeCache.uncached(offsetX, offsetY);
+    
+    int originX = offsetX * (chunkWidth-1) - 1;
+    int originY = offsetY * (chunkHeight-1) - 1;
+    for_each_seam_block(seams, chunkWidth, chunkHeight, rect.firstX, rect.lastX, rect.firstY, rect.lastY, [&](const FbmOctaves &fbm, int firstX, int lastX, int firstY, int lastY) {
+        int width = lastX - firstX, height = lastY - firstY;
+        if (multiRateNoise) {
+            // The coarse grid is anchored to world coordinates, so a block matches the same samples of a whole chunk
+            ArenaScope scratch;
+            std::pmr::vector<float> block(width * height, scratch.resource());
+            FbmMultiRate plan = plan_fbm_multirate(fbm, multiRateStride, multiRateError / ease_height_slope(1, meshHeight));
+            generate_fbm_multirate(pool, block.data(), width, height, originX + firstX + 1, originY + firstY + 1, fbm, plan, noise);
+            for (int y = 0; y < height; y++)
+                std::copy(&block[y*width], &block[y*width] + width, &apronNoise[firstX + 1 + (firstY + 1 + y)*apronWidth]);
+        } else {
+            pool.parallel_for(height, [&](int firstRow, int lastRow) {
+                generate_fbm_block<FIXED_OCTAVES>(apronNoise.data(), apronWidth, firstX + 1, lastX + 1, firstY + 1 + firstRow, firstY + 1 + lastRow,
+                                                  originX, originY, fbm, noise);
+            });
+        }
+    });
+    edgeCache.store_block(offsetX, offsetY, blocks, apronWidth);
+    edgeCache.finish(offsetX, offsetY);
+    
+    std::pmr::vector<float> noiseValues(chunkWidth * chunkHeight, &chunk_arena());
+    for (int y = 0; y < chunkHeight; y++)
+        std::copy(&apronNoise[1 + (y+1)*apronWidth], &apronNoise[1 + (y+1)*apronWidth] + chunkWidth, &noiseValues[y*chunkWidth]);
     
-    for (int y = 0; y < chunkHeight + 1; y++)
+    return noiseValues;
+}
+
+std::pmr::vector<float> generate_vertices(const std::pmr::vector<float> &noise_map) {
+    std::pmr::vector<float> v(&chunk_arena());
+    v.reserve(chunkWidth * chunkHeight * 3);
+    
+    for (int y = 0; y < chunkHeight; y++)
         for (int x = 0; x < chunkWidth; x++) {
             v.push_back(x);
-            // Apply cubic easing to the noise
-            float easedNoise = std::pow(noise_map[x + y*chunkWidth] * 1.1, 3);
-            // Scale noise to match meshHeight
-            // Pervent vertex height from being below WATER_HEIGHT
-            v.push_back(std::fmax(easedNoise * meshHeight, WATER_HEIGHT * 0.5 * meshHeight));
+            // Apply cubic easing to the noise and scale it to match meshHeight
+            v.push_back(ease_height(noise_map[x + y*chunkWidth], meshHeight, WATER_HEIGHT));
             v.push_back(y);
         }
     
     return v;
 }
 
-std::vector<int> generate_indices() {
-    std::vector<int> indices;
+// Position of the vertex at (x, height, y), compact vertices keep only the height, as a fraction of maxHeight
+void set_vertex_position(TerrainVertex &vertex, float x, float height, float y, float) {
+    vertex.position[0] = x;
+    vertex.position[1] = height;
+    vertex.position[2] = y;
+}
+
+void set_vertex_position(CompactTerrainVertex &vertex, float, float height, float, float maxHeight) {
+    vertex.height = pack_height_unorm16(height, maxHeight);
+    vertex.padding = 0;
+}
+
+// Gathers every attribute of a vertex next to each other in one pass, one vertex per noise sample
+template <typename Vertex>
+void interleave_vertices(const std::pmr::vector<float> &vertices, const std::pmr::vector<uint32_t> &normals, const std::pmr::vector<uint8_t> &colors, Vertex *interleaved) {
+    float maxHeight = max_eased_height(meshHeight);
+    
+    for (int i = 0; i < chunkWidth * chunkHeight; i++) {
+        set_vertex_position(interleaved[i], vertices[i*3], vertices[i*3 + 1], vertices[i*3 + 2], maxHeight);
+        interleaved[i].normal = normals[i];
+        std::copy(&colors[i*4], &colors[i*4] + 4, interleaved[i].color);
+    }
+}
+
+// Builds a chunk in one pass over its rows, straight into chunkWidth * chunkHeight upload ready vertices
+// Each band of rows generates noise a row at a time and eases it into a window of 3 rows, with one sample of apron
+// for central differences, then writes every vertex's position, normal and biome color from there
+// Row scratch comes from each thread's chunk arena, so once every thread has built a chunk nothing touches the heap
+// Sample x coordinates are computed once for the whole chunk, every band's octaves are a prefix of the world's
+template <typename Vertex>
+void build_map_chunk(Vertex *vertices, int xOffset, int yOffset, std::vector<plant> &plants, const NoiseContext &noise, ThreadPool &pool, ChunkEdgeCache &edgeCache) {
+    ChunkSeamOctaves seams = get_chunk_seam_octaves(xOffset, yOffset);
+    const std::vector<terrainColor> &biomeColors = get_biome_colors();
+    float maxHeight = max_eased_height(meshHeight);
+    bool analytic = use_analytic_normals();
+    int apronWidth = chunkWidth + 2;
+    int originX = xOffset * (chunkWidth-1);
+    int originY = yOffset * (chunkHeight-1);
+    std::mutex plantsMutex;
+    size_t firstPlant = plants.size();
+    
+    ArenaScope chunkScratch;
+    FbmColumns columns(-1, chunkWidth + 1, originX, get_world_octaves(), chunkScratch.resource());
+    ChunkRect rect = edgeCache.uncached(xOffset, yOffset);
+    
+    pool.parallel_for(chunkHeight, [&](int firstRow, int lastRow) {
+        ArenaScope scratch;
+        FbmRowScratch rowScratch(apronWidth, scratch.resource());
+        std::pmr::vector<float> window(3 * apronWidth, scratch.resource()), noiseRow(apronWidth, scratch.resource());
+        std::pmr::vector<float> noiseDx(chunkWidth, scratch.resource()), noiseDy(chunkWidth, scratch.resource());
+        std::pmr::vector<float> normals(3 * chunkWidth, scratch.resource());
+        float *nx = &normals[0], *ny = &normals[chunkWidth], *nz = &normals[2 * chunkWidth];
+    
+        // Eased heights of apron row apronY, which is chunk row apronY - 1
+        // Neighbouring bands both generate the rows between them, only the band the row belongs to stores it
+        auto ease_apron_row = [&](int apronY) {
+            int y = apronY - 1;
+            float *rows[1] = { &noiseRow[0] };
+            edgeCache.fetch_row(xOffset, yOffset, y, rows);
+            if (y >= rect.firstY && y < rect.lastY)
+                for_each_seam_block(seams, chunkWidth, chunkHeight, rect.firstX, rect.lastX, y, y + 1, [&](const FbmOctaves &fbm, int firstX, int lastX, int, int) {
+                    generate_fbm_row<FIXED_OCTAVES>(&noiseRow[firstX + 1], columns, firstX, lastX, originY + y, fbm, noise, rowScratch);
+                });
+            if ((y >= firstRow && y < lastRow) || y < 0 || y >= chunkHeight)
+                edgeCache.store_row(xOffset, yOffset, y, rows);
+            float *heights = &window[(apronY % 3) * apronWidth];
+            for (int x = 0; x < apronWidth; x++)
+                heights[x] = ease_height(noiseRow[x], meshHeight, WATER_HEIGHT);
+        };
+    
+        if (!analytic) {
+            ease_apron_row(firstRow);
+            ease_apron_row(firstRow + 1);
+        }
     
-    for (int y = 0; y < chunkHeight; y++)
-        for (int x = 0; x < chunkWidth; x++) {
-            int pos = x + y*chunkWidth;
-            
-            if (x == chunkWidth - 1 || y == chunkHeight - 1) {
-                // Don't create indices for right or top edge
-                continue;
+        for (int y = firstRow; y < lastRow; y++) {
+            const float *heights;
+            if (analytic) {
+                // Normals come straight from the noise derivatives
+                float *rows[3] = { &noiseRow[0], &noiseDx[0], &noiseDy[0] };
+                edgeCache.fetch_row(xOffset, yOffset, y, rows);
+                if (y >= rect.firstY && y < rect.lastY)
+                    for_each_seam_block(seams, chunkWidth, chunkHeight, rect.firstX, rect.lastX, y, y + 1, [&](const FbmOctaves &fbm, int firstX, int lastX, int, int) {
+                        generate_fbm_derivative_row<FIXED_OCTAVES>(&noiseRow[firstX], &noiseDx[firstX], &noiseDy[firstX], columns, firstX, lastX, originY + y, fbm, noise, rowScratch);
+                    });
+                edgeCache.store_row(xOffset, yOffset, y, rows);
+                for (int x = 0; x < chunkWidth; x++) {
+                    float normal[3];
+                    eased_normal(noiseRow[x], noiseDx[x], noiseDy[x], meshHeight, WATER_HEIGHT, normal);
+                    nx[x] = normal[0];
+                    ny[x] = normal[1];
+                    nz[x] = normal[2];
+                    window[x] = ease_height(noiseRow[x], meshHeight, WATER_HEIGHT);
+                }
+                heights = &window[0];
             } else {
-                // Top left triangle of square
-                indices.push_back(pos + chunkWidth);
-                indices.push_back(pos);
-                indices.push_back(pos + chunkWidth + 1);
-                // Bottom right triangle of square
-                indices.push_back(pos + 1);
-                indices.push_back(pos + 1 + chunkWidth);
-                indices.push_back(pos);
+                ease_apron_row(y + 2);
+                central_difference_normals_row(&window[(y % 3) * apronWidth], &window[((y + 1) % 3) * apronWidth],
+                                               &window[((y + 2) % 3) * apronWidth], chunkWidth, nx, ny, nz);
+                heights = &window[((y + 1) % 3) * apronWidth + 1];
+            }
+    
+            for (int x = 0; x < chunkWidth; x++) {
+                Vertex &vertex = vertices[x + y*chunkWidth];
+                float normal[3] = { nx[x], ny[x], nz[x] };
+                int biome = get_biome(heights[x]);
+                set_vertex_position(vertex, x, heights[x], y, maxHeight);
+                vertex.normal = pack_normal_2_10_10_10(normal);
+                std::copy(biomeColors[biome].packed, biomeColors[biome].packed + 4, vertex.color);
+    
+                const char *plantType = biome == 3 ? get_plant_type(noise, x, y, xOffset, yOffset) : nullptr;
+                if (plantType) {
+                    std::lock_guard<std::mutex> lock(plantsMutex);
+                    plants.push_back(plant{plantType, (float)x, heights[x], (float)y, xOffset, yOffset});
+                }
             }
         }
+    });
+    edgeCache.finish(xOffset, yOffset);
+    
+    // Bands finish in any order, put the chunk's plants back in row order so render() draws the same ones every run
+    std::sort(plants.begin() + firstPlant, plants.end(), [](const plant &a, const plant &b) {
+        return std::make_tuple(a.zpos, a.xpos) < std::make_tuple(b.zpos, b.xpos);
+    });
+}
 
-    return indices;
+// Triangle list in bands of cacheWindow squares, so vertices are reused while they're still in the vertex cache
+std::vector<int> generate_indices() {
+    return generate_grid_indices(chunkWidth, chunkHeight, cacheWindow);
+}
+
+// Row strips in bands of cacheWindow squares, separated by -1 which becomes the all-ones restart index of either index type
+// Each square gets the same two triangles, with the same winding, as generate_indices()
+std::vector<int> generate_strip_indices() {
+    return generate_grid_strip_indices(chunkWidth, chunkHeight, cacheWindow);
+}
+
+// Uploads indices as the given type, through GL_ARRAY_BUFFER since element array bindings belong to a VAO
+template <typename Index>
+GLuint upload_indices(const std::vector<int> &indices) {
+    std::vector<Index> converted(indices.begin(), indices.end());
+    GLuint EBO;
+    glGenBuffers(1, &EBO);
+    glBindBuffer(GL_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ARRAY_BUFFER, converted.size() * sizeof(Index), &converted[0], GL_STATIC_DRAW);
+    return EBO;
+}
+
+// Builds the shared terrain index buffer for indexMode, from the triangle list when that's the mode
+// With terrainLod it holds every level instead, see 'benchmark lod' for its size
+TerrainIndexBuffer create_terrain_index_buffer(const std::vector<int> &indices) {
+    TerrainIndexBuffer buffer = {};
+    std::vector<int> stripIndices, lodIndices;
+    const std::vector<int> *drawn = &indices;
+    buffer.mode = indexMode == TRIANGLE_STRIPS ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    
+    if (terrainLod) {
+        auto append = [&](const std::vector<int> &part, int &first, int &count) {
+            first = lodIndices.size();
+            count = part.size();
+            lodIndices.insert(lodIndices.end(), part.begin(), part.end());
+        };
+        for (int level = 0; level < LOD_LEVELS; level++) {
+            int stride = 1 << level;
+            if (indexMode == TRIANGLE_STRIPS)
+                append(generate_lod_interior_strip_indices(chunkWidth, chunkHeight, stride, cacheWindow), buffer.lodInteriorFirst[level], buffer.lodInteriorCount[level]);
+            else
+                append(generate_lod_indices(chunkWidth, chunkHeight, stride, 0, cacheWindow, 0), buffer.lodInteriorFirst[level], buffer.lodInteriorCount[level]);
+            buffer.lodInteriorTriangles[level] = lod_interior_triangles(chunkWidth, chunkHeight, stride);
+            
+            // Only the stitch masks made of the part's own sides
+            for (int part = 0; part < LOD_BORDER_PARTS; part++) {
+                int sides = LOD_BORDER_SIDES[part];
+                for (int mask = 0; mask < LOD_STITCH_MASKS; mask++)
+                    if ((mask & ~sides) == 0)
+                        append(generate_lod_indices(chunkWidth, chunkHeight, stride, mask, cacheWindow, sides),
+                               buffer.lodBorderFirst[level][part][mask], buffer.lodBorderCount[level][part][mask]);
+            }
+        }
+        drawn = &lodIndices;
+    } else if (indexMode == TRIANGLE_STRIPS) {
+        stripIndices = generate_strip_indices();
+        drawn = &stripIndices;
+    }
+    buffer.count = drawn->size();
+    
+    // 0xFFFF is kept free for the restart index
+    int indexBytes;
+    if (chunkWidth * chunkHeight < 0xFFFF) {
+        buffer.EBO = upload_indices<uint16_t>(*drawn);
+        buffer.type = GL_UNSIGNED_SHORT;
+        indexBytes = sizeof(uint16_t);
+    } else {
+        buffer.EBO = upload_indices<uint32_t>(*drawn);
+        buffer.type = GL_UNSIGNED_INT;
+        indexBytes = sizeof(uint32_t);
+    }
+    
+    if (buffer.mode == GL_TRIANGLE_STRIP) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(buffer.type == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+    }
+    
+    if (printStats)
+        printf("Terrain index buffer: %d indices, %d bytes\n", (int)drawn->size(), (int)drawn->size() * indexBytes);
+    return buffer;
+}
+
+// Index buffer, empty vertex array and height texture of a clipmap, heights are generated by update_clipmap()
+Clipmap create_clipmap() {
+    Clipmap clipmap = {};
+    int textureSize = clipmapSize + 2;
+    
+    // The full grid, then a ring for every hole position, one after another
+    std::vector<int> indices = generate_clipmap_indices(clipmapSize, -1, -1, cacheWindow);
+    clipmap.fullCount = indices.size();
+    int firstHole = clipmap_first_hole(clipmapSize);
+    for (int y = 0; y < CLIPMAP_HOLE_OFFSETS; y++)
+        for (int x = 0; x < CLIPMAP_HOLE_OFFSETS; x++) {
+            std::vector<int> ring = generate_clipmap_indices(clipmapSize, firstHole + x, firstHole + y, cacheWindow);
+            clipmap.ringFirst[y][x] = indices.size();
+            clipmap.ringCount[y][x] = ring.size();
+            indices.insert(indices.end(), ring.begin(), ring.end());
+        }
+    
+    if (clipmapSize * clipmapSize <= 0xFFFF) {
+        clipmap.EBO = upload_indices<uint16_t>(indices);
+        clipmap.type = GL_UNSIGNED_SHORT;
+    } else {
+        clipmap.EBO = upload_indices<uint32_t>(indices);
+        clipmap.type = GL_UNSIGNED_INT;
+    }
+    glGenVertexArrays(1, &clipmap.VAO);
+    glBindVertexArray(clipmap.VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, clipmap.EBO);
+    
+    // Heights are read with texelFetch, so no filtering
+    glGenTextures(1, &clipmap.heights);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, clipmap.heights);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, textureSize, textureSize, clipmapLevels, 0, GL_RED, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    
+    clipmap.originX.resize(clipmapLevels);
+    clipmap.originY.resize(clipmapLevels);
+    if (printStats)
+        printf("Clipmap: %d levels of %dx%d, %d indices\n", clipmapLevels, clipmapSize, clipmapSize, (int)indices.size());
+    return clipmap;
+}
+
+// Centers every level on the camera, generating and uploading only the samples that came into range
+void update_clipmap(Clipmap &clipmap, const NoiseContext &noise, ThreadPool &pool) {
+    int textureSize = clipmapSize + 2;
+    FbmOctaves fbm = get_fbm_octaves(FbmParams{ octaves, noiseScale, persistence, lacunarity, noisePrecision, noiseBackend, noiseEvaluation });
+    
+    // Noise sample under the camera, see the chunk model matrices in render()
+    float cameraX = camera.Position.x + chunkWidth / 2.0f;
+    float cameraY = camera.Position.z + chunkHeight / 2.0f;
+    
+    glBindTexture(GL_TEXTURE_2D_ARRAY, clipmap.heights);
+    for (int level = 0; level < clipmapLevels; level++) {
+        int originX = clipmap_origin(cameraX, level, clipmapSize);
+        int originY = clipmap_origin(cameraY, level, clipmapSize);
+        FbmOctaves levelFbm = get_clipmap_octaves(fbm, level);
+        
+        // Texture regions start one sample of apron before the origin
+        for (const ClipmapRegion &region : clipmap_update_regions(clipmap.valid, clipmap.originX[level] - 1, clipmap.originY[level] - 1, originX - 1, originY - 1, textureSize)) {
+            ArenaScope scratch;
+            std::pmr::vector<float> heights(region.width * region.height, scratch.resource());
+            generate_fbm_parallel(pool, heights.data(), region.width, region.height, region.x, region.y, levelFbm, noise);
+            for (float &height : heights)
+                height = ease_height(height, meshHeight, WATER_HEIGHT);
+            
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, region.width);
+            split_toroidal(region, textureSize, [&](const ClipmapRegion &part) {
+                glPixelStorei(GL_UNPACK_SKIP_PIXELS, part.x - region.x);
+                glPixelStorei(GL_UNPACK_SKIP_ROWS, part.y - region.y);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, clipmap_texel(part.x, textureSize), clipmap_texel(part.y, textureSize), level,
+                                part.width, part.height, 1, GL_RED, GL_FLOAT, heights.data());
+            });
+        }
+        clipmap.originX[level] = originX;
+        clipmap.originY[level] = originY;
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    clipmap.valid = true;
+}
+
+// Draws every level from the finest out, returns the number of triangles drawn
+int render_clipmap(const Clipmap &clipmap, Shader &shader) {
+    const std::vector<terrainColor> &biomeColors = get_biome_colors();
+    int textureSize = clipmapSize + 2;
+    int indexBytes = clipmap.type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+    int firstHole = clipmap_first_hole(clipmapSize);
+    int triangles = 0;
+    
+    shader.use();
+    shader.setMat4("u_model", glm::translate(glm::mat4(1.0f), glm::vec3(-chunkWidth / 2.0, 0.0, -chunkHeight / 2.0)));
+    shader.setInt("u_heights", 0);
+    shader.setInt("u_gridSize", clipmapSize);
+    shader.setInt("u_textureSize", textureSize);
+    shader.setInt("u_biomes", biomeColors.size());
+    for (int i = 0; i < biomeColors.size(); i++) {
+        const uint8_t *packed = biomeColors[i].packed;
+        shader.setFloat("u_biomeHeights[" + std::to_string(i) + "]", biomeColors[i].height * meshHeight);
+        shader.setVec3("u_biomeColors[" + std::to_string(i) + "]", packed[0] / 255.0f, packed[1] / 255.0f, packed[2] / 255.0f);
+    }
+    
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, clipmap.heights);
+    glBindVertexArray(clipmap.VAO);
+    for (int level = 0; level < clipmapLevels; level++) {
+        int originX = clipmap.originX[level], originY = clipmap.originY[level];
+        shader.setInt("u_level", level);
+        shader.setIVec2("u_origin", originX, originY);
+        shader.setIVec2("u_originTexel", clipmap_texel(originX, textureSize), clipmap_texel(originY, textureSize));
+        shader.setFloat("u_spacing", 1 << level);
+        shader.setFloat("u_morphWidth", level < clipmapLevels - 1 ? clipmapMorphWidth : 0);
+        
+        // The finest level is the full grid, the others leave a hole where the level inside them goes
+        int first = 0, count = clipmap.fullCount;
+        if (level > 0) {
+            int holeX = clipmap_hole(originX, clipmap.originX[level - 1]) - firstHole;
+            int holeY = clipmap_hole(originY, clipmap.originY[level - 1]) - firstHole;
+            first = clipmap.ringFirst[holeY][holeX];
+            count = clipmap.ringCount[holeY][holeX];
+        }
+        glDrawElements(GL_TRIANGLES, count, clipmap.type, (void*)(intptr_t)(first * indexBytes));
+        triangles += count / 3;
+    }
+    return triangles;
 }
 
 // Initialize GLFW and GLAD
@@ -586,9 +1312,9 @@ int init() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
-
+    
     glViewport(0, 0, screenWidth, screenHeight);
-
+    
     // Enable z-buffer
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_FRAMEBUFFER_SRGB);
@@ -599,7 +1325,7 @@ int init() {
     return 0;
 }
 
-void processInput(GLFWwindow *window, Shader &shader) {
+void processInput(GLFWwindow *window, Shader &shader, Shader &clipmapShader) {
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     
@@ -609,13 +1335,17 @@ void processInput(GLFWwindow *window, Shader &shader) {
     
     // Enable flat mode
     if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
-        shader.use();
-        shader.setBool("isFlat", false);
+        for (Shader *s : { &shader, &clipmapShader }) {
+            s->use();
+            s->setBool("isFlat", false);
+        }
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
     if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
-        shader.use();
-        shader.setBool("isFlat", true);
+        for (Shader *s : { &shader, &clipmapShader }) {
+            s->use();
+            s->setBool("isFlat", true);
+        }
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
     
@@ -643,7 +1373,7 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
     
     lastX = xpos;
     lastY = ypos;
-
+    
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
@@ -0,0 +1,31 @@
+#ifndef NOISE_BACKEND_H
+#define NOISE_BACKEND_H
+
+#include "perlin_simd.h"
+#include "simplex.h"
+
+enum NoiseBackend {
+    PERLIN_BACKEND,
+    SIMPLEX_BACKEND
+};
+
+// Batch entry points of one noise algorithm, in both precisions
+// A new backend only needs a pair of batch functions and an entry in get_noise_kernels()
+// Backends that can walk lattice cells along a row also provide row functions, others leave them null
+struct NoiseKernels {
+    const char *name;
+    perlin_batch_fn batch;
+    perlin_batch_f_fn batchF;
+    perlin_row_fn row;
+    perlin_row_f_fn rowF;
+};
+
+const NoiseKernels &get_noise_kernels(NoiseBackend backend) {
+    static const NoiseKernels kernels[] = {
+        { "perlin",  perlin_noise_2d_batch,  perlin_noise_2d_batch_f,  perlin_noise_2d_row, perlin_noise_2d_row_f },
+        { "simplex", simplex_noise_2d_batch, simplex_noise_2d_batch_f, nullptr,             nullptr               },
+    };
+    return kernels[backend];
+}
+
+#endif
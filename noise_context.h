@@ -0,0 +1,54 @@
+#ifndef NOISE_CONTEXT_H
+#define NOISE_CONTEXT_H
+
+#include <cstdint>
+
+#include "perlin.h"
+
+// Permutation table for one world, built once from a 64-bit seed
+// Nothing is written after construction, so one context can be shared by any number of threads
+// NOTE: Keep contexts in static or automatic storage, operator new only honours the alignment from C++17
+class alignas(64) NoiseContext {
+public:
+    // Seed 0 keeps Ken Perlin's reference permutation, any other seed shuffles it
+    explicit NoiseContext(uint64_t seed = 0) : worldSeed(seed) {
+        int permutation[256];
+        for (int i = 0; i < 256; i++)
+            permutation[i] = PERMUTATION[i];
+
+        // Fisher-Yates shuffle driven by splitmix64, so a seed gives the same world on every platform
+        uint64_t state = seed;
+        for (int i = 255; seed != 0 && i > 0; i--) {
+            int j = (int)(splitmix64(state) % (uint64_t)(i + 1));
+            int tmp = permutation[i];
+            permutation[i] = permutation[j];
+            permutation[j] = tmp;
+        }
+
+        // Doubled so corner hashes never need to wrap
+        for (int i = 0; i < 512; i++)
+            p[i] = permutation[i & 255];
+    }
+
+    uint64_t seed() const { return worldSeed; }
+    const int *perm() const { return p; }
+
+    // Well mixed bits for a grid point of this world, for scattering things without a shared random state
+    uint64_t hash(int x, int y) const {
+        uint64_t state = worldSeed ^ ((uint64_t)(uint32_t)x << 32 | (uint32_t)y);
+        return splitmix64(state);
+    }
+
+private:
+    int p[512];
+    uint64_t worldSeed;
+
+    static uint64_t splitmix64(uint64_t &state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+};
+
+#endif
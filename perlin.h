@@ -1,3 +1,9 @@
+#ifndef PERLIN_H
+#define PERLIN_H
+
+#include <cmath>
+#include <vector>
+
 double fade(double t) { return t * t * t * (t * (t * 6 - 15) + 10); };
     
 double lerp(double t, double a, double b) { return a + t * (b - a); }
@@ -9,9 +15,8 @@ double grad(int hash, double x, double y, double z) {
    return ((h&1) == 0 ? u : -u) + ((h&2) == 0 ? v : -v);
 }
     
-double perlin_noise(float x, float y, std::vector<int> &p) {
-    int z = 0.5;
-    
+// Ken Perlin's improved noise, for volumetric sampling
+double perlin_noise(double x, double y, double z, const int *p) {
     int X = (int)floor(x) & 255,                  // FIND UNIT CUBE THAT
         Y = (int)floor(y) & 255,                  // CONTAINS POINT.
         Z = (int)floor(z) & 255;
@@ -34,10 +39,280 @@ double perlin_noise(float x, float y, std::vector<int> &p) {
                                    grad(p[BB+1], x-1, y-1, z-1 ))));
 }
 
-std::vector<int> get_permutation_vector () {
-    std::vector<int> p;
+// 3D noise sampled on the z = 0 plane
+double perlin_noise(float x, float y, std::vector<int> &p) {
+    return perlin_noise(x, y, 0, p.data());
+}
+
+double grad2(int hash, double x, double y) {
+   int h = hash & 7;                       // CONVERT LO 3 BITS OF HASH CODE
+   double u = h<6 ? x : y,                 // INTO 8 GRADIENT DIRECTIONS.
+          v = h<4 ? y : 0;
+   return ((h&1) == 0 ? u : -u) + ((h&2) == 0 ? v : -v);
+}
+
+// 2D gradient noise, 4 square corners and 3 lerps instead of 8 cube corners and 7 lerps
+double perlin_noise_2d(float x, float y, const int *p) {
+    int X = (int)floor(x) & 255,                  // FIND UNIT SQUARE THAT
+        Y = (int)floor(y) & 255;                  // CONTAINS POINT.
+    x -= floor(x);                                // FIND RELATIVE X,Y
+    y -= floor(y);                                // OF POINT IN SQUARE.
+    double u = fade(x),                           // COMPUTE FADE CURVES
+           v = fade(y);                           // FOR EACH OF X,Y.
+    int A = p[X  ]+Y,                             // HASH COORDINATES OF
+        B = p[X+1]+Y;                             // THE 4 SQUARE CORNERS,
+
+    return lerp(v, lerp(u, grad2(p[A  ], x  , y   ),   // AND ADD BLENDED
+                           grad2(p[B  ], x-1, y   )),  // RESULTS FROM 4
+                   lerp(u, grad2(p[A+1], x  , y-1 ),   // CORNERS OF SQUARE
+                           grad2(p[B+1], x-1, y-1 )));
+}
+
+// Single precision versions of the 2D path, for the fast noise mode
+float fadef(float t) { return t * t * t * (t * (t * 6 - 15) + 10); }
+
+float lerpf(float t, float a, float b) { return a + t * (b - a); }
+
+float grad2f(int hash, float x, float y) {
+   int h = hash & 7;
+   float u = h<6 ? x : y,
+         v = h<4 ? y : 0;
+   return ((h&1) == 0 ? u : -u) + ((h&2) == 0 ? v : -v);
+}
+
+float perlin_noise_2d_f(float x, float y, const int *p) {
+    int X = (int)floor(x) & 255,
+        Y = (int)floor(y) & 255;
+    x -= floor(x);
+    y -= floor(y);
+    float u = fadef(x),
+          v = fadef(y);
+    int A = p[X  ]+Y,
+        B = p[X+1]+Y;
+
+    return lerpf(v, lerpf(u, grad2f(p[A  ], x  , y   ),
+                             grad2f(p[B  ], x-1, y   )),
+                    lerpf(u, grad2f(p[A+1], x  , y-1 ),
+                             grad2f(p[B+1], x-1, y-1 )));
+}
+
+double fade_derivative(double t) { return 30 * t * t * (t * (t - 2) + 1); }
+
+// Gradient picked by grad2() for each of the 8 hash directions, as x and y components
+const int GRAD2_X[8] = { 1, -1,  1, -1,  1, -1,  0,  0 };
+const int GRAD2_Y[8] = { 1,  1, -1, -1,  0,  0,  1, -1 };
+
+// One lattice cell of a row of constant y
+// Blending the left and right corner pairs by the row's fade weight leaves two lines in x,
+// so each sample in the cell only needs its own fade weight and a lerp between them
+template <typename Real>
+struct PerlinRowCell {
+    float xFloor;
+    int end;  // One past the last sample in the cell
+    int hA, hB, hA1, hB1;  // Gradient directions of the 4 corners
+    Real leftSlope, leftOffset;
+    Real rightSlope, rightOffset;
+};
+
+// Hashes the cell containing xs[i] and finds how many of the following samples share it
+template <typename Real>
+PerlinRowCell<Real> perlin_row_cell(const float *xs, int i, int n, int Y, Real yf, Real v, const int *p) {
+    PerlinRowCell<Real> cell;
+    cell.xFloor = floor(xs[i]);
+    int X = (int)cell.xFloor & 255;
+    int A = p[X  ]+Y,
+        B = p[X+1]+Y;
+
+    int hA  = cell.hA  = p[A  ] & 7, hB  = cell.hB  = p[B  ] & 7,
+        hA1 = cell.hA1 = p[A+1] & 7, hB1 = cell.hB1 = p[B+1] & 7;
+    cell.leftSlope   = GRAD2_X[hA] + v * (GRAD2_X[hA1] - GRAD2_X[hA]);
+    cell.leftOffset  = GRAD2_Y[hA] * yf + v * (GRAD2_Y[hA1] * (yf - 1) - GRAD2_Y[hA] * yf);
+    cell.rightSlope  = GRAD2_X[hB] + v * (GRAD2_X[hB1] - GRAD2_X[hB]);
+    cell.rightOffset = GRAD2_Y[hB] * yf + v * (GRAD2_Y[hB1] * (yf - 1) - GRAD2_Y[hB] * yf);
+
+    cell.end = i + 1;
+    while (cell.end < n && xs[cell.end] < cell.xFloor + 1)
+        cell.end++;
+    return cell;
+}
+
+// Evaluates perlin_noise_2d() along a row of constant y with increasing x
+// Corner hashes and gradients are looked up once per lattice cell instead of once per sample
+// Matches perlin_noise_2d() up to rounding, the blend is the same bilinear form in a different order
+template <typename Real>
+void perlin_noise_2d_row_t(const float *xs, float y, Real *out, int n, const int *p) {
+    float yFloor = floor(y);
+    int Y = (int)yFloor & 255;
+    Real yf = y - yFloor;
+    Real v = yf * yf * yf * (yf * (yf * 6 - 15) + 10);
+
+    for (int i = 0; i < n;) {
+        PerlinRowCell<Real> cell = perlin_row_cell(xs, i, n, Y, yf, v, p);
+        for (; i < cell.end; i++) {
+            Real xf = xs[i] - cell.xFloor;
+            Real u = xf * xf * xf * (xf * (xf * 6 - 15) + 10);
+            Real left  = cell.leftOffset  + cell.leftSlope  * xf,
+                 right = cell.rightOffset + cell.rightSlope * (xf - 1);
+            out[i] = left + u * (right - left);
+        }
+    }
+}
+
+void perlin_noise_2d_row(const float *xs, float y, double *out, int n, const int *p) {
+    perlin_noise_2d_row_t<double>(xs, y, out, n, p);
+}
+
+// Derivative along y of a row cell's two lines, which are also lines in x
+template <typename Real>
+struct PerlinRowCellDy {
+    Real leftSlope, leftOffset;
+    Real rightSlope, rightOffset;
+};
 
-    std::vector<int> permutation = { 151,160,137,91,90,15,
+template <typename Real>
+PerlinRowCellDy<Real> perlin_row_cell_dy(const PerlinRowCell<Real> &cell, Real yf, Real v, Real dv) {
+    PerlinRowCellDy<Real> dy;
+    dy.leftSlope   = dv * (GRAD2_X[cell.hA1] - GRAD2_X[cell.hA]);
+    dy.leftOffset  = GRAD2_Y[cell.hA] + v * (GRAD2_Y[cell.hA1] - GRAD2_Y[cell.hA])
+                   + dv * (GRAD2_Y[cell.hA1] * (yf - 1) - GRAD2_Y[cell.hA] * yf);
+    dy.rightSlope  = dv * (GRAD2_X[cell.hB1] - GRAD2_X[cell.hB]);
+    dy.rightOffset = GRAD2_Y[cell.hB] + v * (GRAD2_Y[cell.hB1] - GRAD2_Y[cell.hB])
+                   + dv * (GRAD2_Y[cell.hB1] * (yf - 1) - GRAD2_Y[cell.hB] * yf);
+    return dy;
+}
+
+// perlin_noise_2d_row_t() plus the partial derivatives of each sample, in lattice units
+template <typename Real>
+void perlin_noise_2d_row_derivatives_t(const float *xs, float y, Real *out, Real *dxOut, Real *dyOut, int n, const int *p) {
+    float yFloor = floor(y);
+    int Y = (int)yFloor & 255;
+    Real yf = y - yFloor;
+    Real v  = yf * yf * yf * (yf * (yf * 6 - 15) + 10),
+         dv = 30 * yf * yf * (yf * (yf - 2) + 1);
+
+    for (int i = 0; i < n;) {
+        PerlinRowCell<Real> cell = perlin_row_cell(xs, i, n, Y, yf, v, p);
+        PerlinRowCellDy<Real> cellDy = perlin_row_cell_dy(cell, yf, v, dv);
+
+        for (; i < cell.end; i++) {
+            Real xf = xs[i] - cell.xFloor;
+            Real u  = xf * xf * xf * (xf * (xf * 6 - 15) + 10),
+                 du = 30 * xf * xf * (xf * (xf - 2) + 1);
+            Real left  = cell.leftOffset  + cell.leftSlope  * xf,
+                 right = cell.rightOffset + cell.rightSlope * (xf - 1);
+            Real leftDy  = cellDy.leftOffset  + cellDy.leftSlope  * xf,
+                 rightDy = cellDy.rightOffset + cellDy.rightSlope * (xf - 1);
+
+            out[i]   = left + u * (right - left);
+            dxOut[i] = cell.leftSlope + u * (cell.rightSlope - cell.leftSlope) + du * (right - left);
+            dyOut[i] = leftDy + u * (rightDy - leftDy);
+        }
+    }
+}
+
+void perlin_noise_2d_row_derivatives(const float *xs, float y, double *out, double *dxOut, double *dyOut, int n, const int *p) {
+    perlin_noise_2d_row_derivatives_t<double>(xs, y, out, dxOut, dyOut, n, p);
+}
+
+// Noise value with its partial derivatives, in lattice units
+struct NoiseSample {
+    double value;
+    double dx, dy;
+};
+
+// perlin_noise_2d() plus its analytic partial derivatives
+// The value is computed exactly as perlin_noise_2d() computes it
+NoiseSample perlin_noise_2d_derivatives(float x, float y, const int *p) {
+    int X = (int)floor(x) & 255,
+        Y = (int)floor(y) & 255;
+    x -= floor(x);
+    y -= floor(y);
+    double u = fade(x),
+           v = fade(y);
+    int A = p[X  ]+Y,
+        B = p[X+1]+Y;
+    int hA  = p[A  ], hB  = p[B  ],
+        hA1 = p[A+1], hB1 = p[B+1];
+
+    // Bottom and top edges of the square, blended along x
+    double a = grad2(hA,  x, y  ), b = grad2(hB,  x-1, y  ),
+           c = grad2(hA1, x, y-1), d = grad2(hB1, x-1, y-1);
+    double bottom = lerp(u, a, b),
+           top    = lerp(u, c, d);
+
+    // Each corner term is linear in x and y with the corner's gradient as its slope
+    double du = fade_derivative(x),
+           dv = fade_derivative(y);
+    double bottomDx = GRAD2_X[hA  & 7] + du * (b - a) + u * (GRAD2_X[hB  & 7] - GRAD2_X[hA  & 7]),
+           topDx    = GRAD2_X[hA1 & 7] + du * (d - c) + u * (GRAD2_X[hB1 & 7] - GRAD2_X[hA1 & 7]);
+    double bottomDy = GRAD2_Y[hA  & 7] + u * (GRAD2_Y[hB  & 7] - GRAD2_Y[hA  & 7]),
+           topDy    = GRAD2_Y[hA1 & 7] + u * (GRAD2_Y[hB1 & 7] - GRAD2_Y[hA1 & 7]);
+
+    NoiseSample sample;
+    sample.value = lerp(v, bottom, top);
+    sample.dx = lerp(v, bottomDx, topDx);
+    sample.dy = lerp(v, bottomDy, topDy) + dv * (top - bottom);
+    return sample;
+}
+
+// Single precision perlin_noise_2d_derivatives(), the value is computed exactly as perlin_noise_2d_f() computes it
+struct NoiseSampleF {
+    float value;
+    float dx, dy;
+};
+
+NoiseSampleF perlin_noise_2d_derivatives_f(float x, float y, const int *p) {
+    int X = (int)floor(x) & 255,
+        Y = (int)floor(y) & 255;
+    x -= floor(x);
+    y -= floor(y);
+    float u = fadef(x),
+          v = fadef(y);
+    int A = p[X  ]+Y,
+        B = p[X+1]+Y;
+    int hA  = p[A  ], hB  = p[B  ],
+        hA1 = p[A+1], hB1 = p[B+1];
+
+    float a = grad2f(hA,  x, y  ), b = grad2f(hB,  x-1, y  ),
+          c = grad2f(hA1, x, y-1), d = grad2f(hB1, x-1, y-1);
+    float bottom = lerpf(u, a, b),
+          top    = lerpf(u, c, d);
+
+    float du = fade_derivative(x),
+          dv = fade_derivative(y);
+    float bottomDx = GRAD2_X[hA  & 7] + du * (b - a) + u * (GRAD2_X[hB  & 7] - GRAD2_X[hA  & 7]),
+          topDx    = GRAD2_X[hA1 & 7] + du * (d - c) + u * (GRAD2_X[hB1 & 7] - GRAD2_X[hA1 & 7]);
+    float bottomDy = GRAD2_Y[hA  & 7] + u * (GRAD2_Y[hB  & 7] - GRAD2_Y[hA  & 7]),
+          topDy    = GRAD2_Y[hA1 & 7] + u * (GRAD2_Y[hB1 & 7] - GRAD2_Y[hA1 & 7]);
+
+    NoiseSampleF sample;
+    sample.value = lerpf(v, bottom, top);
+    sample.dx = lerpf(v, bottomDx, topDx);
+    sample.dy = lerpf(v, bottomDy, topDy) + dv * (top - bottom);
+    return sample;
+}
+
+// Derivatives of n (x, y) pairs one sample at a time, for octaves too coarse to walk lattice cells
+void perlin_noise_2d_batch_derivatives(const float *x, const float *y, double *out, double *dxOut, double *dyOut, int n, const int *p) {
+    for (int i = 0; i < n; i++) {
+        NoiseSample sample = perlin_noise_2d_derivatives(x[i], y[i], p);
+        out[i] = sample.value;
+        dxOut[i] = sample.dx;
+        dyOut[i] = sample.dy;
+    }
+}
+
+void perlin_noise_2d_batch_derivatives_f(const float *x, const float *y, float *out, float *dxOut, float *dyOut, int n, const int *p) {
+    for (int i = 0; i < n; i++) {
+        NoiseSampleF sample = perlin_noise_2d_derivatives_f(x[i], y[i], p);
+        out[i] = sample.value;
+        dxOut[i] = sample.dx;
+        dyOut[i] = sample.dy;
+    }
+}
+
+// Ken Perlin's reference permutation
+constexpr int PERMUTATION[256] = { 151,160,137,91,90,15,
     131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
     190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
     88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
@@ -50,12 +325,24 @@ std::vector<int> get_permutation_vector () {
     251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
     49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
     138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
-    };
+};
 
-    for (int j = 0; j < 2; j++)
-        for (int i=0; i < 256; i++) {
-            p.push_back(permutation[i]);
-        }
-    
-    return p;
+struct PermutationTable {
+    int p[512];
+};
+
+// Doubled so corner hashes never need to wrap
+constexpr PermutationTable make_permutation_table() {
+    PermutationTable table = {};
+    for (int i = 0; i < 512; i++)
+        table.p[i] = PERMUTATION[i & 255];
+    return table;
+}
+
+constexpr PermutationTable PERMUTATION_TABLE = make_permutation_table();
+
+std::vector<int> get_permutation_vector () {
+    return std::vector<int>(PERMUTATION_TABLE.p, PERMUTATION_TABLE.p + 512);
 }
+
+#endif
@@ -0,0 +1,523 @@
+#ifndef PERLIN_SIMD_H
+#define PERLIN_SIMD_H
+
+#include "perlin.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PERLIN_SIMD_X86 1
+#endif
+
+// Evaluates perlin_noise_2d() for n (x, y) pairs per call
+// All kernels keep the fractional coordinates in float and blend in double like the scalar path
+typedef void (*perlin_batch_fn)(const float *x, const float *y, double *out, int n, const int *p);
+
+void perlin_noise_2d_batch_scalar(const float *x, const float *y, double *out, int n, const int *p) {
+    for (int i = 0; i < n; i++)
+        out[i] = perlin_noise_2d(x[i], y[i], p);
+}
+
+// Single precision batch, blends in float for twice the SIMD width
+typedef void (*perlin_batch_f_fn)(const float *x, const float *y, float *out, int n, const int *p);
+
+void perlin_noise_2d_batch_f_scalar(const float *x, const float *y, float *out, int n, const int *p) {
+    for (int i = 0; i < n; i++)
+        out[i] = perlin_noise_2d_f(x[i], y[i], p);
+}
+
+// Evaluates a row of samples sharing one y, with x increasing, see perlin_noise_2d_row_t()
+typedef void (*perlin_row_fn)(const float *x, float y, double *out, int n, const int *p);
+typedef void (*perlin_row_f_fn)(const float *x, float y, float *out, int n, const int *p);
+
+void perlin_noise_2d_row_f_scalar(const float *x, float y, float *out, int n, const int *p) {
+    perlin_noise_2d_row_t<float>(x, y, out, n, p);
+}
+
+// Single precision row with partial derivatives, see perlin_noise_2d_row_derivatives_t()
+typedef void (*perlin_row_derivatives_f_fn)(const float *x, float y, float *out, float *dx, float *dy, int n, const int *p);
+
+void perlin_noise_2d_row_derivatives_f_scalar(const float *x, float y, float *out, float *dx, float *dy, int n, const int *p) {
+    perlin_noise_2d_row_derivatives_t<float>(x, y, out, dx, dy, n, p);
+}
+
+// Runs a SIMD kernel on the last n < Lanes samples by padding them out to one full vector,
+// so rows that aren't a multiple of the vector width don't drop to the scalar path
+template <int Lanes, typename Out, typename Kernel>
+void batch_tail(Kernel kernel, const float *x, const float *y, Out *out, int n, const int *p) {
+    if (n <= 0)
+        return;
+    float xTail[Lanes], yTail[Lanes];
+    Out outTail[Lanes];
+    for (int j = 0; j < Lanes; j++) {
+        xTail[j] = x[j < n ? j : n - 1];
+        yTail[j] = y[j < n ? j : n - 1];
+    }
+    kernel(xTail, yTail, outTail, Lanes, p);
+    for (int j = 0; j < n; j++)
+        out[j] = outTail[j];
+}
+
+#ifdef PERLIN_SIMD_X86
+__attribute__((target("avx2")))
+static inline __m256d fade_avx2(__m256d t) {
+    __m256d t3 = _mm256_mul_pd(_mm256_mul_pd(t, t), t);
+    __m256d inner = _mm256_add_pd(_mm256_mul_pd(t, _mm256_sub_pd(_mm256_mul_pd(t, _mm256_set1_pd(6)), _mm256_set1_pd(15))), _mm256_set1_pd(10));
+    return _mm256_mul_pd(t3, inner);
+}
+
+__attribute__((target("avx2")))
+static inline __m256d lerp_avx2(__m256d t, __m256d a, __m256d b) {
+    return _mm256_add_pd(a, _mm256_mul_pd(t, _mm256_sub_pd(b, a)));
+}
+
+// grad2() for 4 hashes
+__attribute__((target("avx2")))
+static inline __m256d grad2_avx2(__m128i hash, __m256d x, __m256d y) {
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+    __m256d uIsX = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(6))));
+    __m256d vIsY = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(4))));
+    __m256d u = _mm256_blendv_pd(y, x, uIsX);
+    __m256d v = _mm256_blendv_pd(_mm256_setzero_pd(), y, vIsY);
+
+    // Low two bits of the hash flip the signs of u and v
+    __m256i uSign = _mm256_slli_epi64(_mm256_cvtepi32_epi64(_mm_and_si128(h, _mm_set1_epi32(1))), 63);
+    __m256i vSign = _mm256_slli_epi64(_mm256_cvtepi32_epi64(_mm_srli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 1)), 63);
+    u = _mm256_xor_pd(u, _mm256_castsi256_pd(uSign));
+    v = _mm256_xor_pd(v, _mm256_castsi256_pd(vSign));
+    return _mm256_add_pd(u, v);
+}
+
+// Blends the 4 square corners for 4 samples
+__attribute__((target("avx2")))
+static inline __m256d perlin_blend_avx2(__m128 xf, __m128 yf, __m128 xf1, __m128 yf1,
+                                        __m128i hA, __m128i hB, __m128i hA1, __m128i hB1) {
+    __m256d x  = _mm256_cvtps_pd(xf),  y  = _mm256_cvtps_pd(yf);
+    __m256d x1 = _mm256_cvtps_pd(xf1), y1 = _mm256_cvtps_pd(yf1);
+    __m256d u = fade_avx2(x),
+            v = fade_avx2(y);
+
+    return lerp_avx2(v, lerp_avx2(u, grad2_avx2(hA,  x, y ), grad2_avx2(hB,  x1, y )),
+                        lerp_avx2(u, grad2_avx2(hA1, x, y1), grad2_avx2(hB1, x1, y1)));
+}
+
+// 8 samples per iteration, permutation lookups done with gathers
+__attribute__((target("avx2")))
+void perlin_noise_2d_batch_avx2(const float *x, const float *y, double *out, int n, const int *p) {
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i one  = _mm256_set1_epi32(1);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 xs = _mm256_loadu_ps(x + i),
+               ys = _mm256_loadu_ps(y + i);
+        __m256 xFloor = _mm256_floor_ps(xs),
+               yFloor = _mm256_floor_ps(ys);
+
+        // Find unit square that contains point
+        __m256i X = _mm256_and_si256(_mm256_cvttps_epi32(xFloor), mask),
+                Y = _mm256_and_si256(_mm256_cvttps_epi32(yFloor), mask);
+
+        // Relative x, y of point in square
+        __m256 xf  = _mm256_sub_ps(xs, xFloor),
+               yf  = _mm256_sub_ps(ys, yFloor);
+        __m256 xf1 = _mm256_sub_ps(xf, _mm256_set1_ps(1)),
+               yf1 = _mm256_sub_ps(yf, _mm256_set1_ps(1));
+
+        // Hash coordinates of the 4 corners
+        __m256i A   = _mm256_add_epi32(_mm256_i32gather_epi32(p, X, 4), Y),
+                B   = _mm256_add_epi32(_mm256_i32gather_epi32(p, _mm256_add_epi32(X, one), 4), Y);
+        __m256i hA  = _mm256_i32gather_epi32(p, A, 4),
+                hB  = _mm256_i32gather_epi32(p, B, 4),
+                hA1 = _mm256_i32gather_epi32(p, _mm256_add_epi32(A, one), 4),
+                hB1 = _mm256_i32gather_epi32(p, _mm256_add_epi32(B, one), 4);
+
+        __m256d lo = perlin_blend_avx2(_mm256_castps256_ps128(xf),  _mm256_castps256_ps128(yf),
+                                       _mm256_castps256_ps128(xf1), _mm256_castps256_ps128(yf1),
+                                       _mm256_castsi256_si128(hA),  _mm256_castsi256_si128(hB),
+                                       _mm256_castsi256_si128(hA1), _mm256_castsi256_si128(hB1));
+        __m256d hi = perlin_blend_avx2(_mm256_extractf128_ps(xf, 1),  _mm256_extractf128_ps(yf, 1),
+                                       _mm256_extractf128_ps(xf1, 1), _mm256_extractf128_ps(yf1, 1),
+                                       _mm256_extracti128_si256(hA, 1),  _mm256_extracti128_si256(hB, 1),
+                                       _mm256_extracti128_si256(hA1, 1), _mm256_extracti128_si256(hB1, 1));
+        _mm256_storeu_pd(out + i,     lo);
+        _mm256_storeu_pd(out + i + 4, hi);
+    }
+
+    batch_tail<8>(perlin_noise_2d_batch_avx2, x + i, y + i, out + i, n - i, p);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128d fade_sse41(__m128d t) {
+    __m128d t3 = _mm_mul_pd(_mm_mul_pd(t, t), t);
+    __m128d inner = _mm_add_pd(_mm_mul_pd(t, _mm_sub_pd(_mm_mul_pd(t, _mm_set1_pd(6)), _mm_set1_pd(15))), _mm_set1_pd(10));
+    return _mm_mul_pd(t3, inner);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128d lerp_sse41(__m128d t, __m128d a, __m128d b) {
+    return _mm_add_pd(a, _mm_mul_pd(t, _mm_sub_pd(b, a)));
+}
+
+// grad2() for the 2 hashes in the low half of hash
+__attribute__((target("sse4.1")))
+static inline __m128d grad2_sse41(__m128i hash, __m128d x, __m128d y) {
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+    __m128d uIsX = _mm_castsi128_pd(_mm_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(6))));
+    __m128d vIsY = _mm_castsi128_pd(_mm_cvtepi32_epi64(_mm_cmplt_epi32(h, _mm_set1_epi32(4))));
+    __m128d u = _mm_blendv_pd(y, x, uIsX);
+    __m128d v = _mm_blendv_pd(_mm_setzero_pd(), y, vIsY);
+
+    // Low two bits of the hash flip the signs of u and v
+    __m128i uSign = _mm_slli_epi64(_mm_cvtepi32_epi64(_mm_and_si128(h, _mm_set1_epi32(1))), 63);
+    __m128i vSign = _mm_slli_epi64(_mm_cvtepi32_epi64(_mm_srli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 1)), 63);
+    u = _mm_xor_pd(u, _mm_castsi128_pd(uSign));
+    v = _mm_xor_pd(v, _mm_castsi128_pd(vSign));
+    return _mm_add_pd(u, v);
+}
+
+// Blends the 4 square corners for the 2 samples in the low half of each argument
+__attribute__((target("sse4.1")))
+static inline __m128d perlin_blend_sse41(__m128 xf, __m128 yf, __m128 xf1, __m128 yf1,
+                                         __m128i hA, __m128i hB, __m128i hA1, __m128i hB1) {
+    __m128d x  = _mm_cvtps_pd(xf),  y  = _mm_cvtps_pd(yf);
+    __m128d x1 = _mm_cvtps_pd(xf1), y1 = _mm_cvtps_pd(yf1);
+    __m128d u = fade_sse41(x),
+            v = fade_sse41(y);
+
+    return lerp_sse41(v, lerp_sse41(u, grad2_sse41(hA,  x, y ), grad2_sse41(hB,  x1, y )),
+                         lerp_sse41(u, grad2_sse41(hA1, x, y1), grad2_sse41(hB1, x1, y1)));
+}
+
+// 4 samples per iteration, SSE4.1 has no gather so the hashes are looked up per lane
+__attribute__((target("sse4.1")))
+void perlin_noise_2d_batch_sse41(const float *x, const float *y, double *out, int n, const int *p) {
+    alignas(16) int X[4], Y[4];
+    alignas(16) int hA[4], hB[4], hA1[4], hB1[4];
+    const __m128i mask = _mm_set1_epi32(255);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 xs = _mm_loadu_ps(x + i),
+               ys = _mm_loadu_ps(y + i);
+        __m128 xFloor = _mm_floor_ps(xs),
+               yFloor = _mm_floor_ps(ys);
+
+        // Find unit square that contains point
+        _mm_store_si128((__m128i *)X, _mm_and_si128(_mm_cvttps_epi32(xFloor), mask));
+        _mm_store_si128((__m128i *)Y, _mm_and_si128(_mm_cvttps_epi32(yFloor), mask));
+
+        // Relative x, y of point in square
+        __m128 xf  = _mm_sub_ps(xs, xFloor),
+               yf  = _mm_sub_ps(ys, yFloor);
+        __m128 xf1 = _mm_sub_ps(xf, _mm_set1_ps(1)),
+               yf1 = _mm_sub_ps(yf, _mm_set1_ps(1));
+
+        // Hash coordinates of the 4 corners
+        for (int j = 0; j < 4; j++) {
+            int A = p[X[j]  ]+Y[j],
+                B = p[X[j]+1]+Y[j];
+            hA[j]  = p[A];
+            hB[j]  = p[B];
+            hA1[j] = p[A+1];
+            hB1[j] = p[B+1];
+        }
+        __m128i hashA  = _mm_load_si128((__m128i *)hA),  hashB  = _mm_load_si128((__m128i *)hB),
+                hashA1 = _mm_load_si128((__m128i *)hA1), hashB1 = _mm_load_si128((__m128i *)hB1);
+
+        __m128d lo = perlin_blend_sse41(xf, yf, xf1, yf1, hashA, hashB, hashA1, hashB1);
+        __m128d hi = perlin_blend_sse41(_mm_movehl_ps(xf, xf),   _mm_movehl_ps(yf, yf),
+                                        _mm_movehl_ps(xf1, xf1), _mm_movehl_ps(yf1, yf1),
+                                        _mm_srli_si128(hashA, 8),  _mm_srli_si128(hashB, 8),
+                                        _mm_srli_si128(hashA1, 8), _mm_srli_si128(hashB1, 8));
+        _mm_storeu_pd(out + i,     lo);
+        _mm_storeu_pd(out + i + 2, hi);
+    }
+
+    batch_tail<4>(perlin_noise_2d_batch_sse41, x + i, y + i, out + i, n - i, p);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 fade_avx2_ps(__m256 t) {
+    __m256 t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+    __m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6)), _mm256_set1_ps(15))), _mm256_set1_ps(10));
+    return _mm256_mul_ps(t3, inner);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 lerp_avx2_ps(__m256 t, __m256 a, __m256 b) {
+    return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+// grad2f() for 8 hashes
+__attribute__((target("avx2")))
+static inline __m256 grad2_avx2_ps(__m256i hash, __m256 x, __m256 y) {
+    __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(7));
+    __m256 uIsX = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(6), h));
+    __m256 vIsY = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+    __m256 u = _mm256_blendv_ps(y, x, uIsX);
+    __m256 v = _mm256_blendv_ps(_mm256_setzero_ps(), y, vIsY);
+
+    // Low two bits of the hash flip the signs of u and v
+    __m256i uSign = _mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31);
+    __m256i vSign = _mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30);
+    u = _mm256_xor_ps(u, _mm256_castsi256_ps(uSign));
+    v = _mm256_xor_ps(v, _mm256_castsi256_ps(vSign));
+    return _mm256_add_ps(u, v);
+}
+
+__attribute__((target("avx2")))
+void perlin_noise_2d_batch_f_avx2(const float *x, const float *y, float *out, int n, const int *p) {
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i one  = _mm256_set1_epi32(1);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 xs = _mm256_loadu_ps(x + i),
+               ys = _mm256_loadu_ps(y + i);
+        __m256 xFloor = _mm256_floor_ps(xs),
+               yFloor = _mm256_floor_ps(ys);
+
+        // Find unit square that contains point
+        __m256i X = _mm256_and_si256(_mm256_cvttps_epi32(xFloor), mask),
+                Y = _mm256_and_si256(_mm256_cvttps_epi32(yFloor), mask);
+
+        // Relative x, y of point in square
+        __m256 xf  = _mm256_sub_ps(xs, xFloor),
+               yf  = _mm256_sub_ps(ys, yFloor);
+        __m256 xf1 = _mm256_sub_ps(xf, _mm256_set1_ps(1)),
+               yf1 = _mm256_sub_ps(yf, _mm256_set1_ps(1));
+
+        // Hash coordinates of the 4 corners
+        __m256i A   = _mm256_add_epi32(_mm256_i32gather_epi32(p, X, 4), Y),
+                B   = _mm256_add_epi32(_mm256_i32gather_epi32(p, _mm256_add_epi32(X, one), 4), Y);
+        __m256i hA  = _mm256_i32gather_epi32(p, A, 4),
+                hB  = _mm256_i32gather_epi32(p, B, 4),
+                hA1 = _mm256_i32gather_epi32(p, _mm256_add_epi32(A, one), 4),
+                hB1 = _mm256_i32gather_epi32(p, _mm256_add_epi32(B, one), 4);
+
+        __m256 u = fade_avx2_ps(xf),
+               v = fade_avx2_ps(yf);
+        __m256 noise = lerp_avx2_ps(v, lerp_avx2_ps(u, grad2_avx2_ps(hA,  xf, yf ), grad2_avx2_ps(hB,  xf1, yf )),
+                                       lerp_avx2_ps(u, grad2_avx2_ps(hA1, xf, yf1), grad2_avx2_ps(hB1, xf1, yf1)));
+        _mm256_storeu_ps(out + i, noise);
+    }
+
+    batch_tail<8>(perlin_noise_2d_batch_f_avx2, x + i, y + i, out + i, n - i, p);
+}
+
+// Hashing stays scalar since it happens once per cell, the samples within a cell go 8 at a time
+// Masked loads and stores cover cells that end partway through a vector
+__attribute__((target("avx2")))
+void perlin_noise_2d_row_f_avx2(const float *x, float y, float *out, int n, const int *p) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    float yFloor = floor(y);
+    int Y = (int)yFloor & 255;
+    float yf = y - yFloor;
+    float v = fadef(yf);
+
+    for (int i = 0; i < n;) {
+        PerlinRowCell<float> cell = perlin_row_cell(x, i, n, Y, yf, v, p);
+        __m256 xFloor      = _mm256_set1_ps(cell.xFloor);
+        __m256 leftSlope   = _mm256_set1_ps(cell.leftSlope),
+               leftOffset  = _mm256_set1_ps(cell.leftOffset);
+        __m256 rightSlope  = _mm256_set1_ps(cell.rightSlope),
+               rightOffset = _mm256_set1_ps(cell.rightOffset);
+
+        for (; i < cell.end; i += 8) {
+            __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(cell.end - i), lane);
+            __m256 xf  = _mm256_sub_ps(_mm256_maskload_ps(x + i, active), xFloor);
+            __m256 xf1 = _mm256_sub_ps(xf, _mm256_set1_ps(1));
+            __m256 left  = _mm256_add_ps(leftOffset,  _mm256_mul_ps(leftSlope,  xf)),
+                   right = _mm256_add_ps(rightOffset, _mm256_mul_ps(rightSlope, xf1));
+            _mm256_maskstore_ps(out + i, active, lerp_avx2_ps(fade_avx2_ps(xf), left, right));
+        }
+        i = cell.end;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256 fade_derivative_avx2_ps(__m256 t) {
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(t, _mm256_set1_ps(2))), _mm256_set1_ps(1));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(30), t2), inner);
+}
+
+__attribute__((target("avx2")))
+void perlin_noise_2d_row_derivatives_f_avx2(const float *x, float y, float *out, float *dxOut, float *dyOut, int n, const int *p) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    float yFloor = floor(y);
+    int Y = (int)yFloor & 255;
+    float yf = y - yFloor;
+    float v  = fadef(yf),
+          dv = fade_derivative(yf);
+
+    for (int i = 0; i < n;) {
+        PerlinRowCell<float> cell = perlin_row_cell(x, i, n, Y, yf, v, p);
+        PerlinRowCellDy<float> cellDy = perlin_row_cell_dy(cell, yf, v, dv);
+        __m256 xFloor        = _mm256_set1_ps(cell.xFloor);
+        __m256 leftSlope     = _mm256_set1_ps(cell.leftSlope),
+               leftOffset    = _mm256_set1_ps(cell.leftOffset);
+        __m256 rightSlope    = _mm256_set1_ps(cell.rightSlope),
+               rightOffset   = _mm256_set1_ps(cell.rightOffset);
+        __m256 leftDySlope   = _mm256_set1_ps(cellDy.leftSlope),
+               leftDyOffset  = _mm256_set1_ps(cellDy.leftOffset);
+        __m256 rightDySlope  = _mm256_set1_ps(cellDy.rightSlope),
+               rightDyOffset = _mm256_set1_ps(cellDy.rightOffset);
+
+        for (; i < cell.end; i += 8) {
+            __m256i active = _mm256_cmpgt_epi32(_mm256_set1_epi32(cell.end - i), lane);
+            __m256 xf  = _mm256_sub_ps(_mm256_maskload_ps(x + i, active), xFloor);
+            __m256 xf1 = _mm256_sub_ps(xf, _mm256_set1_ps(1));
+            __m256 u  = fade_avx2_ps(xf),
+                   du = fade_derivative_avx2_ps(xf);
+            __m256 left    = _mm256_add_ps(leftOffset,    _mm256_mul_ps(leftSlope,    xf)),
+                   right   = _mm256_add_ps(rightOffset,   _mm256_mul_ps(rightSlope,   xf1));
+            __m256 leftDy  = _mm256_add_ps(leftDyOffset,  _mm256_mul_ps(leftDySlope,  xf)),
+                   rightDy = _mm256_add_ps(rightDyOffset, _mm256_mul_ps(rightDySlope, xf1));
+
+            __m256 dx = _mm256_add_ps(lerp_avx2_ps(u, leftSlope, rightSlope), _mm256_mul_ps(du, _mm256_sub_ps(right, left)));
+            _mm256_maskstore_ps(out + i,   active, lerp_avx2_ps(u, left, right));
+            _mm256_maskstore_ps(dxOut + i, active, dx);
+            _mm256_maskstore_ps(dyOut + i, active, lerp_avx2_ps(u, leftDy, rightDy));
+        }
+        i = cell.end;
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 fade_sse41_ps(__m128 t) {
+    __m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+    __m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15))), _mm_set1_ps(10));
+    return _mm_mul_ps(t3, inner);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 lerp_sse41_ps(__m128 t, __m128 a, __m128 b) {
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+// grad2f() for 4 hashes
+__attribute__((target("sse4.1")))
+static inline __m128 grad2_sse41_ps(__m128i hash, __m128 x, __m128 y) {
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(7));
+    __m128 uIsX = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(6)));
+    __m128 vIsY = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    __m128 u = _mm_blendv_ps(y, x, uIsX);
+    __m128 v = _mm_blendv_ps(_mm_setzero_ps(), y, vIsY);
+
+    // Low two bits of the hash flip the signs of u and v
+    __m128i uSign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31);
+    __m128i vSign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30);
+    u = _mm_xor_ps(u, _mm_castsi128_ps(uSign));
+    v = _mm_xor_ps(v, _mm_castsi128_ps(vSign));
+    return _mm_add_ps(u, v);
+}
+
+__attribute__((target("sse4.1")))
+void perlin_noise_2d_batch_f_sse41(const float *x, const float *y, float *out, int n, const int *p) {
+    alignas(16) int X[4], Y[4];
+    alignas(16) int hA[4], hB[4], hA1[4], hB1[4];
+    const __m128i mask = _mm_set1_epi32(255);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 xs = _mm_loadu_ps(x + i),
+               ys = _mm_loadu_ps(y + i);
+        __m128 xFloor = _mm_floor_ps(xs),
+               yFloor = _mm_floor_ps(ys);
+
+        // Find unit square that contains point
+        _mm_store_si128((__m128i *)X, _mm_and_si128(_mm_cvttps_epi32(xFloor), mask));
+        _mm_store_si128((__m128i *)Y, _mm_and_si128(_mm_cvttps_epi32(yFloor), mask));
+
+        // Relative x, y of point in square
+        __m128 xf  = _mm_sub_ps(xs, xFloor),
+               yf  = _mm_sub_ps(ys, yFloor);
+        __m128 xf1 = _mm_sub_ps(xf, _mm_set1_ps(1)),
+               yf1 = _mm_sub_ps(yf, _mm_set1_ps(1));
+
+        // Hash coordinates of the 4 corners
+        for (int j = 0; j < 4; j++) {
+            int A = p[X[j]  ]+Y[j],
+                B = p[X[j]+1]+Y[j];
+            hA[j]  = p[A];
+            hB[j]  = p[B];
+            hA1[j] = p[A+1];
+            hB1[j] = p[B+1];
+        }
+        __m128i hashA  = _mm_load_si128((__m128i *)hA),  hashB  = _mm_load_si128((__m128i *)hB),
+                hashA1 = _mm_load_si128((__m128i *)hA1), hashB1 = _mm_load_si128((__m128i *)hB1);
+
+        __m128 u = fade_sse41_ps(xf),
+               v = fade_sse41_ps(yf);
+        __m128 noise = lerp_sse41_ps(v, lerp_sse41_ps(u, grad2_sse41_ps(hashA,  xf, yf ), grad2_sse41_ps(hashB,  xf1, yf )),
+                                        lerp_sse41_ps(u, grad2_sse41_ps(hashA1, xf, yf1), grad2_sse41_ps(hashB1, xf1, yf1)));
+        _mm_storeu_ps(out + i, noise);
+    }
+
+    batch_tail<4>(perlin_noise_2d_batch_f_sse41, x + i, y + i, out + i, n - i, p);
+}
+#endif
+
+// Picks the widest kernel the CPU supports
+perlin_batch_fn select_perlin_batch() {
+#ifdef PERLIN_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return perlin_noise_2d_batch_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return perlin_noise_2d_batch_sse41;
+#endif
+    return perlin_noise_2d_batch_scalar;
+}
+
+void perlin_noise_2d_batch(const float *x, const float *y, double *out, int n, const int *p) {
+    static const perlin_batch_fn batch = select_perlin_batch();
+    batch(x, y, out, n, p);
+}
+
+perlin_batch_f_fn select_perlin_batch_f() {
+#ifdef PERLIN_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return perlin_noise_2d_batch_f_avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return perlin_noise_2d_batch_f_sse41;
+#endif
+    return perlin_noise_2d_batch_f_scalar;
+}
+
+void perlin_noise_2d_batch_f(const float *x, const float *y, float *out, int n, const int *p) {
+    static const perlin_batch_f_fn batch = select_perlin_batch_f();
+    batch(x, y, out, n, p);
+}
+
+perlin_row_f_fn select_perlin_row_f() {
+#ifdef PERLIN_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return perlin_noise_2d_row_f_avx2;
+#endif
+    return perlin_noise_2d_row_f_scalar;
+}
+
+void perlin_noise_2d_row_f(const float *x, float y, float *out, int n, const int *p) {
+    static const perlin_row_f_fn row = select_perlin_row_f();
+    row(x, y, out, n, p);
+}
+
+perlin_row_derivatives_f_fn select_perlin_row_derivatives_f() {
+#ifdef PERLIN_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return perlin_noise_2d_row_derivatives_f_avx2;
+#endif
+    return perlin_noise_2d_row_derivatives_f_scalar;
+}
+
+void perlin_noise_2d_row_derivatives_f(const float *x, float y, float *out, float *dx, float *dy, int n, const int *p) {
+    static const perlin_row_derivatives_f_fn row = select_perlin_row_derivatives_f();
+    row(x, y, out, dx, dy, n, p);
+}
+
+#endif
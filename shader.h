@@ -90,6 +90,9 @@ public:
     void setVec2(const std::string &name, float x, float y) const {
         glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
     }
+    void setIVec2(const std::string &name, int x, int y) const {
+        glUniform2i(glGetUniformLocation(ID, name.c_str()), x, y);
+    }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const {
         glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
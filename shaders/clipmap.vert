@@ -0,0 +1,67 @@
+#version 330 core
+flat out vec3 flatColor;
+out vec3 Color;
+out vec3 Normal;
+out vec3 FragPos;
+
+uniform mat4 u_model;
+uniform mat4 u_view;
+uniform mat4 u_projection;
+
+// Eased heights of every level, one layer each, kept toroidally so moving a level only rewrites the samples it uncovered
+uniform sampler2DArray u_heights;
+uniform int u_level;
+uniform int u_gridSize;     // Vertices across a level
+uniform int u_textureSize;  // Samples across a layer, the grid plus one of apron on every side
+uniform ivec2 u_origin;       // Sample of vertex (0, 0), in samples of this level
+uniform ivec2 u_originTexel;  // Texel holding it
+uniform float u_spacing;      // World units between samples of this level
+
+// Vertices from the outer edge over which heights blend into the next level's, 0 for the outermost level
+uniform float u_morphWidth;
+
+// Biome colors by height, see get_biome_colors()
+const int MAX_BIOMES = 8;
+uniform int u_biomes;
+uniform float u_biomeHeights[MAX_BIOMES];
+uniform vec3 u_biomeColors[MAX_BIOMES];
+
+float height(int i, int j) {
+    ivec2 texel = (u_originTexel + ivec2(i, j) + u_textureSize) % u_textureSize;
+    return texelFetch(u_heights, ivec3(texel, u_level), 0).r;
+}
+
+void main() {
+    int i = gl_VertexID % u_gridSize;
+    int j = gl_VertexID / u_gridSize;
+    float h = height(i, j);
+
+    // Vertices the next level doesn't have slide onto its triangles towards the outer edge, so the levels meet without cracks
+    // Origins are even, so odd vertices are the middle of a coarser edge or of its bottom left to top right diagonal
+    int edge = min(min(i, j), u_gridSize - 1 - max(i, j));
+    float morph = u_morphWidth > 0 ? clamp(1.0 - edge / u_morphWidth, 0.0, 1.0) : 0.0;
+    if (morph > 0 && (i % 2 == 1 || j % 2 == 1)) {
+        float coarse;
+        if (i % 2 == 1 && j % 2 == 1)
+            coarse = (height(i - 1, j - 1) + height(i + 1, j + 1)) / 2;
+        else if (i % 2 == 1)
+            coarse = (height(i - 1, j) + height(i + 1, j)) / 2;
+        else
+            coarse = (height(i, j - 1) + height(i, j + 1)) / 2;
+        h = mix(h, coarse, morph);
+    }
+
+    // Central differences like the chunks' normals, the grid puts samples y along world z
+    Normal = normalize(vec3(height(i - 1, j) - height(i + 1, j), 2 * u_spacing, height(i, j - 1) - height(i, j + 1)));
+
+    int biome = u_biomes - 1;
+    for (int b = u_biomes - 2; b >= 0; b--)
+        if (h <= u_biomeHeights[b])
+            biome = b;
+    Color = u_biomeColors[biome];
+    flatColor = Color;
+
+    vec3 position = vec3((u_origin.x + i) * u_spacing, h, (u_origin.y + j) * u_spacing);
+    FragPos = vec3(u_model * vec4(position, 1.0));
+    gl_Position = u_projection * u_view * u_model * vec4(position, 1.0);
+}
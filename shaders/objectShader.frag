@@ -1,15 +1,50 @@
 #version 330 core
 flat in vec3 flatColor;
 in vec3 Color;
+in vec3 Normal;
+in vec3 FragPos;
 
 out vec4 FragColor;
 
+struct Light {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+uniform Light light;
+uniform vec3 u_viewPos;
+
 uniform bool isFlat;
 
+vec3 calculateLighting(vec3 Normal, vec3 FragPos) {
+    // Ambient lighting
+    vec3 ambient = light.ambient;
+    
+    // Diffuse lighting
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(lightDir, norm), 0.0);
+    vec3 diffuse = light.diffuse * diff;
+
+    // Specular lighting
+    float specularStrength = 0.5;
+    vec3 viewDir = normalize(u_viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, Normal);
+
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16);
+    vec3 specular = light.specular * spec;
+    
+    return (ambient + diffuse + specular);
+}
+
 void main() {
     if (isFlat) {
-        FragColor = vec4(flatColor, 1.0);
+        // Face normal of the triangle from how the position changes across the screen, always facing the camera
+        vec3 faceNormal = normalize(cross(dFdx(FragPos), dFdy(FragPos)));
+        FragColor = vec4(flatColor * calculateLighting(faceNormal, FragPos), 1.0);
     } else {
-        FragColor = vec4(Color, 1.0);
+        FragColor = vec4(Color * calculateLighting(Normal, FragPos), 1.0);
     }
 }
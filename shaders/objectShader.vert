@@ -6,50 +6,33 @@ layout (location = 3) in vec3 aOffset;
 
 flat out vec3 flatColor;
 out vec3 Color;
-
-struct Light {
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-uniform Light light;
-uniform vec3 u_viewPos;
+out vec3 Normal;
+out vec3 FragPos;
 
 uniform mat4 u_model;
 uniform mat4 u_view;
 uniform mat4 u_projection;
 
-vec3 calculateLighting(vec3 Normal, vec3 FragPos) {
-    // Ambient lighting
-    vec3 ambient = light.ambient;
-    
-    // Diffuse lighting
-    vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(-light.direction);
-    float diff = max(dot(lightDir, norm), 0.0);
-    vec3 diffuse = light.diffuse * diff;
+// Compact terrain vertices only store a height, x and z come from the vertex's place in the chunk grid
+uniform bool u_compactTerrain;
+uniform int u_chunkWidth;
+uniform float u_maxHeight;
 
-    // Specular lighting
-    float specularStrength = 0.5;
-    vec3 viewDir = normalize(u_viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, Normal);
-
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16);
-    vec3 specular = light.specular * spec;
-    
-    return (ambient + diffuse + specular);
-}
+// Vertex colors are stored as bytes, brighter colors are scaled up here
+uniform float u_colorScale;
 
 void main() {
-    vec3 FragPos = vec3(u_model * vec4(aPos + aOffset, 1.0));
-    vec3 Normal = aNormal;
-//    vec3 Normal = transpose(inverse(mat3(u_model))) * aNormal;
+    vec3 position = aPos;
+    if (u_compactTerrain)
+        position = vec3(gl_VertexID % u_chunkWidth, aPos.x * u_maxHeight, gl_VertexID / u_chunkWidth);
+    
+    // Lighting is per fragment, flat shading needs the face normal there
+    FragPos = vec3(u_model * vec4(position + aOffset, 1.0));
+    Normal = aNormal;
+//    Normal = transpose(inverse(mat3(u_model))) * aNormal;
 
-    vec3 lighting = calculateLighting(Normal, FragPos);
-    Color = aColor * lighting;
+    Color = aColor * u_colorScale;
     flatColor = Color;
     
-    gl_Position = u_projection * u_view * u_model * vec4(aPos + aOffset, 1.0);
+    gl_Position = u_projection * u_view * u_model * vec4(position + aOffset, 1.0);
 }
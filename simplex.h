@@ -0,0 +1,151 @@
+#ifndef SIMPLEX_H
+#define SIMPLEX_H
+
+#include <cmath>
+
+#include "perlin.h"
+#include "perlin_simd.h"
+
+// 2D simplex noise on a skewed triangular lattice
+// Each sample blends 3 corners instead of Perlin's 4, and the lattice has no axis aligned square cells
+// Hashes come from the same permutation table and gradient set as perlin_noise_2d()
+
+const float SIMPLEX_F2 = 0.36602540378f;  // (sqrt(3) - 1) / 2, skews input space onto the lattice
+const float SIMPLEX_G2 = 0.21132486540f;  // (3 - sqrt(3)) / 6, unskews it back
+const float SIMPLEX_SCALE = 70;           // Brings the output to roughly -1 to 1
+
+double simplex_grad(int hash, double x, double y) { return grad2(hash, x, y); }
+
+float simplex_grad(int hash, float x, float y) { return grad2f(hash, x, y); }
+
+template <typename Real>
+Real simplex_corner(int hash, Real x, Real y) {
+    Real t = Real(0.5) - x*x - y*y;
+    t = t < 0 ? 0 : t;
+    t *= t;
+    return t * t * simplex_grad(hash, x, y);
+}
+
+template <typename Real>
+Real simplex_noise_2d_t(float x, float y, const int *p) {
+    // Skew to find the lattice cell
+    float s = (x + y) * SIMPLEX_F2;
+    float fi = floor(x + s),
+          fj = floor(y + s);
+    float t = (fi + fj) * SIMPLEX_G2;
+
+    // Distance to the cell origin in unskewed space
+    Real x0 = x - (fi - t),
+         y0 = y - (fj - t);
+
+    // Which of the cell's two triangles the point is in
+    int i1 = x0 > y0 ? 1 : 0,
+        j1 = 1 - i1;
+
+    Real x1 = x0 - i1 + SIMPLEX_G2,     y1 = y0 - j1 + SIMPLEX_G2;
+    Real x2 = x0 - 1 + 2 * SIMPLEX_G2,  y2 = y0 - 1 + 2 * SIMPLEX_G2;
+
+    // Hash the 3 corners
+    int ii = (int)fi & 255,
+        jj = (int)fj & 255;
+    int h0 = p[ii      + p[jj     ]],
+        h1 = p[ii + i1 + p[jj + j1]],
+        h2 = p[ii + 1  + p[jj + 1 ]];
+
+    return SIMPLEX_SCALE * (simplex_corner(h0, x0, y0) + simplex_corner(h1, x1, y1) + simplex_corner(h2, x2, y2));
+}
+
+double simplex_noise_2d(float x, float y, const int *p) {
+    return simplex_noise_2d_t<double>(x, y, p);
+}
+
+float simplex_noise_2d_f(float x, float y, const int *p) {
+    return simplex_noise_2d_t<float>(x, y, p);
+}
+
+void simplex_noise_2d_batch(const float *x, const float *y, double *out, int n, const int *p) {
+    for (int i = 0; i < n; i++)
+        out[i] = simplex_noise_2d(x[i], y[i], p);
+}
+
+void simplex_noise_2d_batch_f_scalar(const float *x, const float *y, float *out, int n, const int *p) {
+    for (int i = 0; i < n; i++)
+        out[i] = simplex_noise_2d_f(x[i], y[i], p);
+}
+
+#ifdef PERLIN_SIMD_X86
+__attribute__((target("avx2")))
+static inline __m256 simplex_corner_avx2(__m256i hash, __m256 x, __m256 y) {
+    __m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y));
+    t = _mm256_max_ps(t, _mm256_setzero_ps());
+    t = _mm256_mul_ps(t, t);
+    return _mm256_mul_ps(_mm256_mul_ps(t, t), grad2_avx2_ps(hash, x, y));
+}
+
+// 8 samples per iteration, the triangle choice is a blend instead of a branch
+__attribute__((target("avx2")))
+void simplex_noise_2d_batch_f_avx2(const float *x, const float *y, float *out, int n, const int *p) {
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i one  = _mm256_set1_epi32(1);
+    const __m256 G2 = _mm256_set1_ps(SIMPLEX_G2);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 xs = _mm256_loadu_ps(x + i),
+               ys = _mm256_loadu_ps(y + i);
+
+        // Skew to find the lattice cell
+        __m256 s = _mm256_mul_ps(_mm256_add_ps(xs, ys), _mm256_set1_ps(SIMPLEX_F2));
+        __m256 fi = _mm256_floor_ps(_mm256_add_ps(xs, s)),
+               fj = _mm256_floor_ps(_mm256_add_ps(ys, s));
+        __m256 t = _mm256_mul_ps(_mm256_add_ps(fi, fj), G2);
+
+        // Distance to the cell origin in unskewed space
+        __m256 x0 = _mm256_sub_ps(xs, _mm256_sub_ps(fi, t)),
+               y0 = _mm256_sub_ps(ys, _mm256_sub_ps(fj, t));
+
+        // Which of the cell's two triangles the point is in
+        __m256 lower = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+        __m256 i1 = _mm256_and_ps(lower, _mm256_set1_ps(1)),
+               j1 = _mm256_andnot_ps(lower, _mm256_set1_ps(1));
+        __m256i i1i = _mm256_cvttps_epi32(i1),
+                j1i = _mm256_cvttps_epi32(j1);
+
+        __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, i1), G2),
+               y1 = _mm256_add_ps(_mm256_sub_ps(y0, j1), G2);
+        __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_set1_ps(1)), _mm256_set1_ps(2 * SIMPLEX_G2)),
+               y2 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_set1_ps(1)), _mm256_set1_ps(2 * SIMPLEX_G2));
+
+        // Hash the 3 corners
+        __m256i ii = _mm256_and_si256(_mm256_cvttps_epi32(fi), mask),
+                jj = _mm256_and_si256(_mm256_cvttps_epi32(fj), mask);
+        __m256i h0 = _mm256_i32gather_epi32(p, _mm256_add_epi32(ii, _mm256_i32gather_epi32(p, jj, 4)), 4);
+        __m256i h1 = _mm256_i32gather_epi32(p, _mm256_add_epi32(_mm256_add_epi32(ii, i1i),
+                                                                _mm256_i32gather_epi32(p, _mm256_add_epi32(jj, j1i), 4)), 4);
+        __m256i h2 = _mm256_i32gather_epi32(p, _mm256_add_epi32(_mm256_add_epi32(ii, one),
+                                                                _mm256_i32gather_epi32(p, _mm256_add_epi32(jj, one), 4)), 4);
+
+        __m256 noise = _mm256_add_ps(_mm256_add_ps(simplex_corner_avx2(h0, x0, y0), simplex_corner_avx2(h1, x1, y1)),
+                                     simplex_corner_avx2(h2, x2, y2));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(noise, _mm256_set1_ps(SIMPLEX_SCALE)));
+    }
+
+    batch_tail<8>(simplex_noise_2d_batch_f_avx2, x + i, y + i, out + i, n - i, p);
+}
+#endif
+
+perlin_batch_f_fn select_simplex_batch_f() {
+#ifdef PERLIN_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return simplex_noise_2d_batch_f_avx2;
+#endif
+    return simplex_noise_2d_batch_f_scalar;
+}
+
+void simplex_noise_2d_batch_f(const float *x, const float *y, float *out, int n, const int *p) {
+    static const perlin_batch_f_fn batch = select_simplex_batch_f();
+    batch(x, y, out, n, p);
+}
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "chunk_arena.h"
+#include "thread_pool.h"
+
+// Applies cubic easing to a normalized noise value and scales it to world units
+// Heights never go below the deep water level
+float ease_height(float noise, float meshHeight, float waterHeight) {
+    // Cubed by multiplication, std::pow is most of the cost of easing a chunk
+    double scaled = noise * 1.1;
+    float easedNoise = scaled * scaled * scaled;
+    return std::fmax(easedNoise * meshHeight, waterHeight * 0.5 * meshHeight);
+}
+
+// Rate of change of ease_height() in world units per unit of normalized noise, ignoring the water floor
+// Converts world height tolerances into noise tolerances
+float ease_height_slope(float noise, float meshHeight) {
+    return 3 * std::pow(1.1, 3) * noise * noise * meshHeight;
+}
+
+// Tallest height ease_height() can give, normalized fBm never goes above 2 since the first octave has amplitude 1
+float max_eased_height(float meshHeight) {
+    return ease_height(2, meshHeight, 0);
+}
+
+// Height as a fraction of maxHeight in 16 bits, for GL_UNSIGNED_SHORT normalized vertex attributes
+// At the default meshHeight of 32 one step is about 0.005 world units
+uint16_t pack_height_unorm16(float height, float maxHeight) {
+    float t = std::fmin(std::fmax(height / maxHeight, 0.0f), 1.0f);
+    return (uint16_t)(t * 65535 + 0.5f);
+}
+
+// How terrain vertex normals are made
+enum NormalMode {
+    AREA_WEIGHTED_NORMALS,       // Sum of the triangles around each vertex weighted by their area, any backend
+    CENTRAL_DIFFERENCE_NORMALS,  // Differences of the heights around each vertex, any backend
+    ANALYTIC_NORMALS             // Derivatives of the noise itself, Perlin backend only
+};
+
+// Unit normal of the eased terrain at a vertex, from its normalized noise and the noise derivatives per world unit
+// Every chunk computes the same normal for a shared border vertex, the water floor is flat
+void eased_normal(float noise, float dx, float dy, float meshHeight, float waterHeight, float normal[3]) {
+    float eased = noise * 1.1f;
+    float slope = eased * eased * eased > waterHeight * 0.5f ? ease_height_slope(noise, meshHeight) : 0;
+
+    // The mesh puts noise y along world z
+    float nx = -slope * dx, ny = 1, nz = -slope * dy;
+    float length = std::sqrt(nx*nx + ny*ny + nz*nz);
+    normal[0] = nx / length;
+    normal[1] = ny / length;
+    normal[2] = nz / length;
+}
+
+// One row of unit normals from central differences of eased heights, the grid spacing is one world unit
+// below, row and above are rows y - 1, y and y + 1 with one sample of apron on both ends, width + 2 long
+// No branches in the loop, so it vectorizes
+void central_difference_normals_row(const float *below, const float *row, const float *above, int width,
+                                    float *nx, float *ny, float *nz) {
+    for (int x = 0; x < width; x++) {
+        // Twice the slopes, the mesh puts noise y along world z
+        float dx = row[x] - row[x + 2];
+        float dz = below[x + 1] - above[x + 1];
+        float inverseLength = 1 / std::sqrt(dx*dx + 4 + dz*dz);
+        nx[x] = dx * inverseLength;
+        ny[x] = 2 * inverseLength;
+        nz[x] = dz * inverseLength;
+    }
+}
+
+// Normals of a width x height chunk from its normalized noise with one sample of apron on every side,
+// (width + 2) x (height + 2), so border vertices see the same neighbours as in the chunk next to them
+// A single pass that eases each noise row once into a window of 3 rows, rowFn(y, nx, ny, nz) gets every row of normals
+template <typename RowFn>
+void central_difference_normals(const float *apronNoise, int width, int height, float meshHeight, float waterHeight, RowFn rowFn) {
+    int apronWidth = width + 2;
+    ArenaScope scratch;
+    std::pmr::vector<float> window(3 * apronWidth, scratch.resource()), normals(3 * width, scratch.resource());
+
+    auto ease_row = [&](int apronRow) {
+        const float *noise = apronNoise + apronRow * apronWidth;
+        float *heights = &window[(apronRow % 3) * apronWidth];
+        for (int x = 0; x < apronWidth; x++)
+            heights[x] = ease_height(noise[x], meshHeight, waterHeight);
+    };
+
+    ease_row(0);
+    ease_row(1);
+    for (int y = 0; y < height; y++) {
+        ease_row(y + 2);
+        central_difference_normals_row(&window[(y % 3) * apronWidth], &window[((y + 1) % 3) * apronWidth],
+                                       &window[((y + 2) % 3) * apronWidth], width, &normals[0], &normals[width], &normals[2 * width]);
+        rowFn(y, &normals[0], &normals[width], &normals[2 * width]);
+    }
+}
+
+// Smooth normals of a width x height chunk, the sum of the unnormalized face normals of the 6 triangles around
+// each vertex, so bigger triangles count for more. Takes normalized noise with one sample of apron on every side
+// Each row of squares adds its triangles to the row of vertices above it and the row below it in two separate
+// arrays, so threads splitting the squares by row never write the same value and need no atomics. Every vertex is
+// then the sum of its two halves, made in the same order in every chunk, so border normals match exactly
+template <typename RowFn>
+void area_weighted_normals(ThreadPool &pool, const float *apronNoise, int width, int height, float meshHeight, float waterHeight, RowFn rowFn) {
+    int apronWidth = width + 2, apronHeight = height + 2;
+    ArenaScope scratch;
+    std::pmr::vector<float> heights(apronWidth * apronHeight, scratch.resource());
+    std::pmr::vector<float> fromAbove(3 * apronWidth * apronHeight, scratch.resource()), fromBelow(3 * apronWidth * apronHeight, scratch.resource());
+
+    pool.parallel_for(apronHeight, [&](int firstRow, int lastRow) {
+        for (int i = firstRow * apronWidth; i < lastRow * apronWidth; i++)
+            heights[i] = ease_height(apronNoise[i], meshHeight, waterHeight);
+    });
+
+    pool.parallel_for(apronHeight - 1, [&](int firstRow, int lastRow) {
+        for (int y = firstRow; y < lastRow; y++) {
+            float *bottom = &fromAbove[3 * y * apronWidth], *top = &fromBelow[3 * (y + 1) * apronWidth];
+            std::fill(bottom, bottom + 3 * apronWidth, 0.0f);
+            std::fill(top, top + 3 * apronWidth, 0.0f);
+
+            for (int x = 0; x < apronWidth - 1; x++) {
+                float b = heights[x + y*apronWidth], br = heights[x + 1 + y*apronWidth];
+                float t = heights[x + (y+1)*apronWidth], tr = heights[x + 1 + (y+1)*apronWidth];
+
+                // Twice the area times the unit normal of the square's two triangles, as generate_indices() splits it
+                float first[3] = { t - tr, 1, b - t }, second[3] = { b - br, 1, br - tr };
+                for (int i = 0; i < 3; i++) {
+                    top[3*x + i]          += first[i];
+                    bottom[3*x + i]       += first[i] + second[i];
+                    top[3*(x + 1) + i]    += first[i] + second[i];
+                    bottom[3*(x + 1) + i] += second[i];
+                }
+            }
+        }
+    });
+
+    // Apron vertices are missing triangles, only the chunk's own are finished
+    pool.parallel_for(height, [&](int firstRow, int lastRow) {
+        ArenaScope rowScratch;
+        std::pmr::vector<float> nx(width, rowScratch.resource()), ny(width, rowScratch.resource()), nz(width, rowScratch.resource());
+        for (int y = firstRow; y < lastRow; y++) {
+            const float *above = &fromAbove[3 * ((y + 1) * apronWidth + 1)], *below = &fromBelow[3 * ((y + 1) * apronWidth + 1)];
+            for (int x = 0; x < width; x++) {
+                float n[3] = { below[3*x] + above[3*x], below[3*x + 1] + above[3*x + 1], below[3*x + 2] + above[3*x + 2] };
+                float inverseLength = 1 / std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                nx[x] = n[0] * inverseLength;
+                ny[x] = n[1] * inverseLength;
+                nz[x] = n[2] * inverseLength;
+            }
+            rowFn(y, nx.data(), ny.data(), nz.data());
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef TERRAIN_LOD_H
+#define TERRAIN_LOD_H
+
+#include <algorithm>
+#include <vector>
+
+// Geomipmapping: chunks far from the camera are drawn from every 2nd, 4th or 8th vertex of their grid
+// Levels are only index sets, every level draws from the chunk's one vertex buffer
+// A chunk next to a coarser one folds the edge vertices the neighbour doesn't have onto the previous vertex kept
+// along that edge, so both draw the same edge segments and no cracks open between them. Neighbours are kept at
+// most one level apart, so an edge only ever has to match the next level down. See 'benchmark lod'
+// Stitching only changes the squares along the sides, so a level is stored as its interior, drawn the same for every
+// neighbour, plus each border part for every way its own sides can be stitched
+
+const int LOD_LEVELS = 4;         // Vertex strides 1, 2, 4 and 8
+const int LOD_STITCH_MASKS = 16;  // Every combination of LodSide
+
+// Sides of a chunk whose neighbour is one level coarser
+enum LodSide {
+    LOD_LEFT   = 1,  // x = 0
+    LOD_RIGHT  = 2,  // x = width - 1
+    LOD_BOTTOM = 4,  // y = 0
+    LOD_TOP    = 8   // y = height - 1
+};
+
+// Squares along the sides by the sides they touch, corners touch two
+// Every level needs at least 3 squares across, so no square touches opposite sides
+const int LOD_BORDER_PARTS = 8;
+const int LOD_BORDER_SIDES[LOD_BORDER_PARTS] = { LOD_LEFT, LOD_RIGHT, LOD_BOTTOM, LOD_TOP,
+                                                 LOD_LEFT | LOD_BOTTOM, LOD_RIGHT | LOD_BOTTOM, LOD_LEFT | LOD_TOP, LOD_RIGHT | LOD_TOP };
+const int LOD_ALL_SQUARES = -1;
+
+// Grid lines of a level across size vertices, every stride-th one plus the last
+// A size that isn't a multiple of the stride plus one gets a narrower last row of squares,
+// and the lines of a level are still a subset of the finer level's
+std::vector<int> lod_grid_lines(int size, int stride) {
+    std::vector<int> lines;
+    for (int i = 0; i < size - 1; i += stride)
+        lines.push_back(i);
+    lines.push_back(size - 1);
+    return lines;
+}
+
+// Where a vertex on a stitched side goes, the previous vertex along the side that the next level keeps
+int fold_lod_vertex(int i, int size, int stride) {
+    return i == size - 1 ? i : i / (2 * stride) * (2 * stride);
+}
+
+// Sides of the chunk that square (column, row) of a level with nColumns x nRows grid lines touches, 0 inside
+int lod_square_sides(int column, int row, int nColumns, int nRows) {
+    return (column == 0 ? LOD_LEFT : 0) | (column == nColumns - 2 ? LOD_RIGHT : 0)
+         | (row == 0 ? LOD_BOTTOM : 0) | (row == nRows - 2 ? LOD_TOP : 0);
+}
+
+// Triangle list of a width x height grid drawn with the given vertex stride, in bands of window squares across
+// like generate_grid_indices(), which it matches for stride 1 with no stitched sides
+// Vertices on the sides in stitchMask are folded for a neighbour with twice the stride, triangles that collapse are left out
+// A part other than LOD_ALL_SQUARES keeps only the squares touching exactly those sides, 0 for the interior
+std::vector<int> generate_lod_indices(int width, int height, int stride, int stitchMask, int window, int part = LOD_ALL_SQUARES) {
+    std::vector<int> columns = lod_grid_lines(width, stride), rows = lod_grid_lines(height, stride);
+    int nColumns = columns.size(), nRows = rows.size();
+    std::vector<int> indices;
+    indices.reserve((nColumns - 1) * (nRows - 1) * 6);
+
+    auto vertex = [&](int column, int row) {
+        int x = columns[column], y = rows[row];
+        if (((stitchMask & LOD_BOTTOM) && y == 0) || ((stitchMask & LOD_TOP) && y == height - 1))
+            x = fold_lod_vertex(x, width, stride);
+        if (((stitchMask & LOD_LEFT) && x == 0) || ((stitchMask & LOD_RIGHT) && x == width - 1))
+            y = fold_lod_vertex(y, height, stride);
+        return x + y*width;
+    };
+    auto triangle = [&](int a, int b, int c) {
+        if (a == b || b == c || a == c)
+            return;
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    };
+
+    for (int bandX = 0; bandX < nColumns - 1; bandX += window) {
+        int bandEnd = std::min(bandX + window, nColumns - 1);
+        for (int y = 0; y < nRows - 1; y++)
+            for (int i = 0; i < bandEnd - bandX; i++) {
+                int x = y % 2 == 0 ? bandX + i : bandEnd - 1 - i;
+                if (part != LOD_ALL_SQUARES && lod_square_sides(x, y, nColumns, nRows) != part)
+                    continue;
+                // Top left triangle of square
+                triangle(vertex(x, y + 1), vertex(x, y), vertex(x + 1, y + 1));
+                // Bottom right triangle of square
+                triangle(vertex(x + 1, y), vertex(x + 1, y + 1), vertex(x, y));
+            }
+    }
+
+    return indices;
+}
+
+// The interior of a level as strips separated by -1, the same walk and triangles as generate_grid_strip_indices()
+std::vector<int> generate_lod_interior_strip_indices(int width, int height, int stride, int window) {
+    std::vector<int> columns = lod_grid_lines(width, stride), rows = lod_grid_lines(height, stride);
+    int nColumns = columns.size(), nRows = rows.size();
+    std::vector<int> indices;
+
+    for (int bandX = 1; bandX < nColumns - 2; bandX += window) {
+        int bandEnd = std::min(bandX + window, nColumns - 2);
+        for (int y = 1; y < nRows - 2; y++) {
+            if (!indices.empty())
+                indices.push_back(-1);
+            for (int i = 0; i <= bandEnd - bandX; i++) {
+                int x = y % 2 == 0 ? bandX + i : bandEnd - i;
+                int bottom = columns[x] + rows[y]*width, top = columns[x] + rows[y + 1]*width;
+                if (y % 2 == 0) {
+                    indices.push_back(top);
+                    indices.push_back(bottom);
+                } else {
+                    indices.push_back(bottom);
+                    indices.push_back(top);
+                }
+            }
+        }
+    }
+
+    return indices;
+}
+
+// Triangles in the interior of a level
+int lod_interior_triangles(int width, int height, int stride) {
+    return ((int)lod_grid_lines(width, stride).size() - 3) * ((int)lod_grid_lines(height, stride).size() - 3) * 2;
+}
+
+// Level of a chunk whose center is distance away, one level coarser every time the distance doubles past lodDistance
+int select_lod_level(float distance, float lodDistance) {
+    int level = 0;
+    while (level < LOD_LEVELS - 1 && distance > lodDistance * (1 << level))
+        level++;
+    return level;
+}
+
+// Lowers the levels of an xChunks x yChunks grid of chunks until every pair of neighbours is at most one level apart
+void limit_lod_steps(std::vector<int> &levels, int xChunks, int yChunks) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int y = 0; y < yChunks; y++)
+            for (int x = 0; x < xChunks; x++) {
+                int &level = levels[x + y*xChunks];
+                int limit = level;
+                if (x > 0)           limit = std::min(limit, levels[x - 1 + y*xChunks] + 1);
+                if (x < xChunks - 1) limit = std::min(limit, levels[x + 1 + y*xChunks] + 1);
+                if (y > 0)           limit = std::min(limit, levels[x + (y - 1)*xChunks] + 1);
+                if (y < yChunks - 1) limit = std::min(limit, levels[x + (y + 1)*xChunks] + 1);
+                if (limit < level) {
+                    level = limit;
+                    changed = true;
+                }
+            }
+    }
+}
+
+// Sides of chunk (x, y) to stitch, the ones with a coarser neighbour
+int lod_stitch_mask(const std::vector<int> &levels, int x, int y, int xChunks, int yChunks) {
+    int level = levels[x + y*xChunks], mask = 0;
+    if (x > 0 && levels[x - 1 + y*xChunks] > level)           mask |= LOD_LEFT;
+    if (x < xChunks - 1 && levels[x + 1 + y*xChunks] > level) mask |= LOD_RIGHT;
+    if (y > 0 && levels[x + (y - 1)*xChunks] > level)         mask |= LOD_BOTTOM;
+    if (y < yChunks - 1 && levels[x + (y + 1)*xChunks] > level) mask |= LOD_TOP;
+    return mask;
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for splitting one job across cores
+// The thread calling parallel_for() works too, so a pool of size 1 has no workers and runs everything inline
+class ThreadPool {
+public:
+    explicit ThreadPool(int nThreads) {
+        for (int i = 1; i < nThreads; i++)
+            workers.push_back(std::thread([this] { work(); }));
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    int size() const { return (int)workers.size() + 1; }
+
+    // Splits [0, count) into one contiguous band per thread and calls fn(begin, end) for each band
+    // Returns once every band is done
+    // The job lives on the caller's stack and workers pick bands off it, so nothing is allocated per call
+    template <typename Fn>
+    void parallel_for(int count, const Fn &fn) {
+        int nBands = std::min(count, size());
+        if (nBands <= 1) {
+            if (count > 0)
+                fn(0, count);
+            return;
+        }
+
+        Job job;
+        job.fn = &fn;
+        job.run = [](const void *fn, int begin, int end) { (*(const Fn *)fn)(begin, end); };
+        job.count = count;
+        job.nBands = nBands;
+        job.nextBand = 1;
+        job.remaining = nBands - 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Job **last = &jobs;
+            while (*last)
+                last = &(*last)->next;
+            *last = &job;
+        }
+        wake.notify_all();
+
+        // First band runs on the calling thread
+        fn(0, count / nBands);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        job.done.wait(lock, [&] { return job.remaining == 0; });
+    }
+
+private:
+    // Bands of one parallel_for() call still waiting for a worker, calls queue up through next
+    struct Job {
+        void (*run)(const void *fn, int begin, int end);
+        const void *fn;
+        int count;
+        int nBands;
+        int nextBand;   // Next band to hand out
+        int remaining;  // Bands handed to workers and not finished yet
+        std::condition_variable done;
+        Job *next = nullptr;
+    };
+
+    std::vector<std::thread> workers;
+    Job *jobs = nullptr;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            Job *job;
+            int band;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || jobs; });
+                if (!jobs)
+                    return;
+                job = jobs;
+                band = job->nextBand++;
+                if (job->nextBand == job->nBands)
+                    jobs = job->next;
+            }
+            job->run(job->fn, job->count * band / job->nBands, job->count * (band + 1) / job->nBands);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--job->remaining == 0)
+                job->done.notify_one();
+        }
+    }
+};
+
+#endif
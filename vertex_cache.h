@@ -0,0 +1,183 @@
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Triangle orders that reuse vertices while they're still in the GPU's post-transform cache,
+// and an offline FIFO cache to measure them with, see 'benchmark cache'
+// Index lists here use -1 for a primitive restart
+
+// Average cache miss ratio, vertices transformed per triangle drawn, of indices in draw order on a FIFO cache
+// A regular grid can get close to 0.5, 3 means nothing is reused
+float simulate_acmr(const std::vector<int> &indices, int triangles, int cacheSize) {
+    std::vector<int> fifo(cacheSize, -1);
+    int next = 0, misses = 0;
+    for (int index : indices) {
+        if (index < 0 || std::find(fifo.begin(), fifo.end(), index) != fifo.end())
+            continue;
+        fifo[next] = index;
+        next = (next + 1) % cacheSize;
+        misses++;
+    }
+    return (float)misses / triangles;
+}
+
+// Triangle list of a width x height grid of vertices, walked in bands of window squares across
+// Each band goes up the grid row by row, reversing direction every row, so the vertices shared with the
+// row below are the ones loaded last. A band needs about 2 * (window + 1) cache entries, a window of
+// width - 1 is the plain row-major order
+std::vector<int> generate_grid_indices(int width, int height, int window) {
+    std::vector<int> indices;
+    indices.reserve((width - 1) * (height - 1) * 6);
+
+    for (int bandX = 0; bandX < width - 1; bandX += window) {
+        int bandEnd = std::min(bandX + window, width - 1);
+        for (int y = 0; y < height - 1; y++)
+            for (int i = 0; i < bandEnd - bandX; i++) {
+                int x = y % 2 == 0 ? bandX + i : bandEnd - 1 - i;
+                int pos = x + y*width;
+                // Top left triangle of square
+                indices.push_back(pos + width);
+                indices.push_back(pos);
+                indices.push_back(pos + width + 1);
+                // Bottom right triangle of square
+                indices.push_back(pos + 1);
+                indices.push_back(pos + 1 + width);
+                indices.push_back(pos);
+            }
+    }
+
+    return indices;
+}
+
+// Same walk as generate_grid_indices() with every row of a band as one strip, strips are separated by -1
+// Rows going right to left start on the bottom vertex, so every triangle keeps the list's winding
+std::vector<int> generate_grid_strip_indices(int width, int height, int window) {
+    std::vector<int> indices;
+
+    for (int bandX = 0; bandX < width - 1; bandX += window) {
+        int bandEnd = std::min(bandX + window, width - 1);
+        for (int y = 0; y < height - 1; y++) {
+            if (!indices.empty())
+                indices.push_back(-1);
+            for (int i = 0; i <= bandEnd - bandX; i++) {
+                int pos = y % 2 == 0 ? bandX + i + y*width : bandEnd - i + y*width;
+                if (y % 2 == 0) {
+                    indices.push_back(pos + width);
+                    indices.push_back(pos);
+                } else {
+                    indices.push_back(pos);
+                    indices.push_back(pos + width);
+                }
+            }
+        }
+    }
+
+    return indices;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation, for meshes without a regular structure
+// Greedily emits the triangle whose vertices score highest, recently used vertices and vertices with
+// few triangles left score higher, so the mesh is finished off in patches
+const int FORSYTH_CACHE_SIZE = 32;
+
+float forsyth_vertex_score(int cachePosition, int remainingTriangles) {
+    if (remainingTriangles == 0)
+        return -1;
+
+    float score = 0;
+    if (cachePosition >= 0) {
+        // The last triangle's vertices score the same so it doesn't matter which one it ended on
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1 - (float)(cachePosition - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+
+    // Vertices with few triangles left are finished off first
+    return score + 2 / std::sqrt((float)remainingTriangles);
+}
+
+std::vector<int> optimize_vertex_cache(const std::vector<int> &indices, int vertexCount) {
+    int triangleCount = indices.size() / 3;
+
+    // Triangles not yet emitted that use each vertex, in one array with an offset per vertex
+    std::vector<int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+    for (int index : indices)
+        remaining[index]++;
+    for (int v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<int> vertexTriangles(indices.size()), filled(vertexCount, 0);
+    for (int i = 0; i < (int)indices.size(); i++)
+        vertexTriangles[offsets[indices[i]] + filled[indices[i]]++] = i / 3;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        vertexScore[v] = forsyth_vertex_score(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (int t = 0; t < triangleCount; t++)
+        triangleScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t + 1]] + vertexScore[indices[3*t + 2]];
+
+    std::vector<int> cache, nextCache, ordered;
+    ordered.reserve(indices.size());
+    int best = -1, firstLeft = 0;
+
+    for (int n = 0; n < triangleCount; n++) {
+        // Nothing left around the cache, carry on from the first triangle not yet emitted
+        // Searching the whole mesh for the best score instead is quadratic on meshes of many small pieces
+        if (best < 0) {
+            while (emitted[firstLeft])
+                firstLeft++;
+            best = firstLeft;
+        }
+
+        emitted[best] = true;
+        const int *corners = &indices[3 * best];
+        ordered.insert(ordered.end(), corners, corners + 3);
+
+        // Take the triangle off its vertices' lists
+        for (int i = 0; i < 3; i++) {
+            int v = corners[i];
+            int *first = &vertexTriangles[offsets[v]];
+            std::swap(*std::find(first, first + remaining[v], best), first[remaining[v] - 1]);
+            remaining[v]--;
+        }
+
+        // Its vertices move to the front of the cache, anything pushed past the end falls out
+        nextCache.assign(corners, corners + 3);
+        for (int v : cache)
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                nextCache.push_back(v);
+        for (int i = 0; i < (int)nextCache.size(); i++)
+            cachePosition[nextCache[i]] = i < FORSYTH_CACHE_SIZE ? i : -1;
+
+        // Rescore everything the cache touched, the best of those goes next
+        best = -1;
+        for (int v : nextCache) {
+            vertexScore[v] = forsyth_vertex_score(cachePosition[v], remaining[v]);
+            for (int i = 0; i < remaining[v]; i++) {
+                int t = vertexTriangles[offsets[v] + i];
+                triangleScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t + 1]] + vertexScore[indices[3*t + 2]];
+            }
+        }
+        for (int v : nextCache)
+            for (int i = 0; i < remaining[v]; i++) {
+                int t = vertexTriangles[offsets[v] + i];
+                if (best < 0 || triangleScore[t] > triangleScore[best])
+                    best = t;
+            }
+
+        if ((int)nextCache.size() > FORSYTH_CACHE_SIZE)
+            nextCache.resize(FORSYTH_CACHE_SIZE);
+        std::swap(cache, nextCache);
+    }
+
+    return ordered;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include <cmath>
+#include <cstdint>
+
+// Quantized vertex attributes, the GL side reads them back as normalized values
+
+// Unit normal as signed 10-bit x, y and z, for GL_INT_2_10_10_10_REV normalized vertex attributes
+// Off by at most about 0.1 degrees, the shader normalizes it again
+uint32_t pack_normal_2_10_10_10(const float normal[3]) {
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; i++) {
+        float n = std::fmin(std::fmax(normal[i], -1.0f), 1.0f);
+        int q = (int)std::lround(n * 511);
+        packed |= ((uint32_t)q & 0x3FF) << (10 * i);
+    }
+    return packed;
+}
+
+// Color channels between 0 and 1 as bytes, for GL_UNSIGNED_BYTE normalized vertex attributes
+// The fourth byte pads the color to 4 bytes so the next attribute stays aligned
+void pack_color_unorm8(const float color[3], uint8_t out[4]) {
+    for (int i = 0; i < 3; i++)
+        out[i] = (uint8_t)(std::fmin(std::fmax(color[i], 0.0f), 1.0f) * 255 + 0.5f);
+    out[3] = 255;
+}
+
+#endif